@@ -21,9 +21,9 @@
 #include "bitboards.h"
 #include "utils.h"
 
-// _BTYPE is set to 1 for BMI2 builds
+// _BTYPE is set to 1 for BMI2 builds, a dispatching build decides on pext at startup
 // include headers for pext intrinsic
-#if defined(_BTYPE) && (_BTYPE == 1)
+#if (defined(_BTYPE) && (_BTYPE == 1)) || defined(USE_DISPATCH)
 #if _WIN32 || _WIN64
 #include <immintrin.h>
 #endif
@@ -32,6 +32,13 @@
 #endif
 #endif
 
+#if defined(USE_DISPATCH)
+#include "cpu.h"
+
+// slider attacks are indexed with pext, when it is fast, or with the magic multipliers
+static bool s_pext = false;
+#endif
+
 U64 BB_SINGLE[64];
 U64 BB_DIR[64][8];
 U64 BB_BETWEEN[64][64];
@@ -255,6 +262,8 @@ U64 BishopAttacks(FLD f, U64 occ)
 {
 #if defined(_BTYPE) && (_BTYPE == 1)
     int index = _pext_u64(occ, B_MASK[f]);
+#elif defined(USE_DISPATCH)
+    int index = s_pext ? int(_pext_u64(occ, B_MASK[f])) : int(((occ & B_MASK[f]) * B_MULT[f]) >> B_SHIFT[f]);
 #else
     int index = int(((occ & B_MASK[f]) * B_MULT[f]) >> B_SHIFT[f]);
 #endif
@@ -520,6 +529,10 @@ void InitBitboards()
     FLD f, from, to;
     int delta;
 
+#if defined(USE_DISPATCH)
+    s_pext = Cpu::fastPext();
+#endif
+
     x = LL(0x8000000000000000);
     for (f = 0; f < 64; ++f)
     {
@@ -668,6 +681,8 @@ void InitBitboards()
             U64 occ = EnumBits(mask, n);
 #if defined(_BTYPE) && (_BTYPE == 1)
             int index = _pext_u64(occ, mask);
+#elif defined(USE_DISPATCH)
+            int index = s_pext ? int(_pext_u64(occ, mask)) : int((occ * B_MULT[f]) >> (64 - bits));
 #else
             U64 mult = B_MULT[f];
             int index = int((occ * mult) >> (64 - bits));
@@ -690,6 +705,8 @@ void InitBitboards()
             U64 occ = EnumBits(mask, n);
 #if defined(_BTYPE) && (_BTYPE == 1)
             int index = _pext_u64(occ, mask);
+#elif defined(USE_DISPATCH)
+            int index = s_pext ? int(_pext_u64(occ, mask)) : int((occ * R_MULT[f]) >> (64 - bits));
 #else
             U64 mult = R_MULT[f];
             int index = int((occ * mult) >> (64 - bits));
@@ -747,6 +764,8 @@ U64 RookAttacks(FLD f, U64 occ)
 {
 #if defined(_BTYPE) && (_BTYPE == 1)
     int index = _pext_u64(occ, R_MASK[f]);
+#elif defined(USE_DISPATCH)
+    int index = s_pext ? int(_pext_u64(occ, R_MASK[f])) : int(((occ & R_MASK[f]) * R_MULT[f]) >> R_SHIFT[f]);
 #else
     int index = int(((occ & R_MASK[f]) * R_MULT[f]) >> R_SHIFT[f]);
 #endif
@@ -0,0 +1,144 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cpu.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#include <cstring>
+
+namespace {
+
+struct Features
+{
+    bool avx2       = false;
+    bool avx512     = false;
+    bool vnni       = false;
+    bool bmi2       = false;
+    bool slowPext   = false;
+
+    Features()
+    {
+        U32 regs[4];
+
+        cpuid(0, 0, regs);
+        const U32 maxLeaf = regs[0];
+
+        char vendor[13] = {};
+        std::memcpy(vendor + 0, &regs[1], 4);
+        std::memcpy(vendor + 4, &regs[3], 4);
+        std::memcpy(vendor + 8, &regs[2], 4);
+
+        if (maxLeaf < 7)
+            return;
+
+        cpuid(1, 0, regs);
+
+        U32 family = (regs[0] >> 8) & 0xF;
+        if (family == 0xF)
+            family += (regs[0] >> 20) & 0xFF;
+
+        // the os must save the ymm, and for AVX-512 the opmask and zmm, registers on a switch
+        const bool osxsave = (regs[2] >> 27) & 1;
+        const bool avx     = (regs[2] >> 28) & 1;
+        const U64 xcr0     = osxsave ? xgetbv() : 0;
+        const bool ymm     = (xcr0 & 0x06) == 0x06;
+        const bool zmm     = (xcr0 & 0xE6) == 0xE6;
+
+        cpuid(7, 0, regs);
+
+        avx2     = avx && ymm && ((regs[1] >> 5) & 1);
+        avx512   = avx2 && zmm && ((regs[1] >> 16) & 1) && ((regs[1] >> 30) & 1);
+        vnni     = avx512 && ((regs[2] >> 11) & 1);
+        bmi2     = (regs[1] >> 8) & 1;
+        slowPext = !std::strcmp(vendor, "AuthenticAMD") && family < 0x19;
+    }
+
+    static void cpuid(U32 leaf, U32 subleaf, U32 regs[4])
+    {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<U32>(r[i]);
+#elif defined(__GNUC__)
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    static U64 xgetbv()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#elif defined(__GNUC__)
+        U32 lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (static_cast<U64>(hi) << 32) | lo;
+#else
+        return 0;
+#endif
+    }
+};
+
+const Features & features()
+{
+    static const Features instance;
+    return instance;
+}
+
+} // namespace
+
+bool Cpu::hasAvx2()
+{
+    return features().avx2;
+}
+
+bool Cpu::fastPext()
+{
+    return features().bmi2 && !features().slowPext;
+}
+
+Cpu::Isa Cpu::isa()
+{
+    if (features().vnni)
+        return Isa::Avx512Vnni;
+
+    if (features().avx512)
+        return Isa::Avx512;
+
+    return Isa::Avx2;
+}
+
+const char * Cpu::isaName()
+{
+    switch (isa()) {
+    case Isa::Avx512Vnni:
+        return "AVX512 VNNI512";
+    case Isa::Avx512:
+        return "AVX512";
+    default:
+        return "AVX2";
+    }
+}
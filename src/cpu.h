@@ -0,0 +1,47 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "types.h"
+
+//
+//  Features of the processor the engine runs on, read once with cpuid. A build made with
+//  USE_DISPATCH picks its network kernels and slider attack indexing from these at startup
+//
+
+class Cpu
+{
+public:
+    enum class Isa
+    {
+        Avx2,
+        Avx512,     // AVX-512 F and BW
+        Avx512Vnni  // AVX-512 F, BW and VNNI
+    };
+
+public:
+    static bool hasAvx2();
+    static bool fastPext(); // BMI2 present and pext not microcoded, as it is before Zen 3
+    static Isa isa();       // the widest instruction set there are kernels for
+    static const char * isaName();
+};
+
+#endif // CPU_H
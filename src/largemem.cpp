@@ -0,0 +1,313 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2018-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "largemem.h"
+
+#include <cstdlib>
+#include <utility>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+//  from linux/mman.h, which is not always installed
+//
+
+static constexpr int MAP_HUGE_SHIFT_ = 26;
+static constexpr int MAP_HUGE_2MB_   = 21 << MAP_HUGE_SHIFT_;
+static constexpr int MAP_HUGE_1GB_   = 30 << MAP_HUGE_SHIFT_;
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+static constexpr size_t PAGE_2M = 1ull << 21;
+static constexpr size_t PAGE_1G = 1ull << 30;
+static constexpr size_t ALIGNMENT = 64;
+
+static size_t roundUp(size_t size, size_t page)
+{
+    return (size + page - 1) / page * page;
+}
+
+LargeMemory::LargeMemory() : m_data(nullptr), m_size(0), m_mapped(0), m_mode(Mode::None)
+{
+}
+
+LargeMemory::~LargeMemory()
+{
+    release();
+}
+
+bool LargeMemory::allocate(size_t size)
+{
+    release();
+
+    if (!size)
+        return false;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+    //
+    //  explicit huge pages only come from the pool reserved by the administrator
+    //  (vm.nr_hugepages), so these fail quickly on most systems. 1 GB pages are only
+    //  worth it when they do not round the block up by more than a page
+    //
+
+    auto mapHuge = [&](size_t page, int flags, Mode mode) {
+        size_t mapped = roundUp(size, page);
+        void * p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags, -1, 0);
+
+        if (p == MAP_FAILED)
+            return false;
+
+        m_data   = p;
+        m_mapped = mapped;
+        m_mode   = mode;
+        return true;
+    };
+
+    if (size >= PAGE_1G && !(size % PAGE_1G) && mapHuge(PAGE_1G, MAP_HUGE_1GB_, Mode::HugeTlb1G)) {
+        m_size = size;
+        return true;
+    }
+
+    if (size >= PAGE_2M && mapHuge(PAGE_2M, MAP_HUGE_2MB_, Mode::HugeTlb2M)) {
+        m_size = size;
+        return true;
+    }
+
+    //
+    //  on linux systems we align on 2MB boundaries and request Huge Pages
+    //  idea comes from Sami Kiminki as used in Ethereal
+    //
+
+    if (size >= PAGE_2M) {
+        m_data = aligned_alloc(PAGE_2M, roundUp(size, PAGE_2M));
+
+        if (m_data) {
+            madvise(m_data, roundUp(size, PAGE_2M), MADV_HUGEPAGE);
+            m_size   = size;
+            m_mapped = roundUp(size, PAGE_2M);
+            m_mode = Mode::Transparent;
+            return true;
+        }
+    }
+
+    m_data = aligned_alloc(ALIGNMENT, roundUp(size, ALIGNMENT));
+#elif defined(_MSC_VER)
+    m_data = _aligned_malloc(size, ALIGNMENT);
+#else
+    m_data = aligned_alloc(ALIGNMENT, roundUp(size, ALIGNMENT));
+#endif
+
+    if (!m_data)
+        return false;
+
+    m_size = size;
+    m_mode = Mode::Normal;
+    return true;
+}
+
+//
+//  maps size bytes of the file starting at offset, which must be a multiple of the page size.
+//  Writes stay private to the process, and pages are read from the file on first access.
+//  The current block is kept when the file cannot be mapped
+//
+
+bool LargeMemory::map(const std::string & path, size_t offset, size_t size)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (!size)
+        return false;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    release();
+
+    m_data   = p;
+    m_size   = size;
+    m_mapped = size;
+    m_mode   = Mode::File;
+    return true;
+#else
+    (void)path; (void)offset; (void)size;
+    return false;
+#endif
+}
+
+//
+//  attaches to the shared memory segment with the given name, creating it with size bytes when
+//  it does not exist yet. An existing segment keeps the size it was created with, so every
+//  process sees the same block. The segment outlives the processes using it until it is removed
+//  with unlink
+//
+
+bool LargeMemory::attach(const std::string & name, size_t size, bool & created)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (!size || name.empty())
+        return false;
+
+    const std::string segment = name[0] == '/' ? name : "/" + name;
+
+    created = true;
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd >= 0) {
+        if (ftruncate(fd, static_cast<off_t>(size))) {
+            close(fd);
+            shm_unlink(segment.c_str());
+            return false;
+        }
+    }
+    else {
+        created = false;
+        fd = shm_open(segment.c_str(), O_RDWR, 0600);
+
+        if (fd < 0)
+            return false;
+
+        //
+        //  the process that created the segment may not have sized it yet
+        //
+
+        struct stat st = {};
+
+        for (int i = 0; i < 100 && !fstat(fd, &st) && !st.st_size; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        size = static_cast<size_t>(st.st_size);
+
+        if (!size) {
+            close(fd);
+            return false;
+        }
+    }
+
+    void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    madvise(p, size, MADV_HUGEPAGE);
+    release();
+
+    m_data   = p;
+    m_size   = size;
+    m_mapped = size;
+    m_mode   = Mode::Shared;
+    return true;
+#else
+    (void)name; (void)size; (void)created;
+    return false;
+#endif
+}
+
+//
+//  removes the name of a shared memory segment, processes attached to it keep their mapping
+//
+
+/*static */bool LargeMemory::unlink(const std::string & name)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (name.empty())
+        return false;
+
+    const std::string segment = name[0] == '/' ? name : "/" + name;
+    return !shm_unlink(segment.c_str());
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+void LargeMemory::release()
+{
+    if (!m_data)
+        return;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (m_mode == Mode::HugeTlb1G || m_mode == Mode::HugeTlb2M || m_mode == Mode::File || m_mode == Mode::Shared)
+        munmap(m_data, m_mapped);
+    else
+        free(m_data);
+#elif defined(_MSC_VER)
+    _aligned_free(m_data);
+#else
+    free(m_data);
+#endif
+
+    m_data   = nullptr;
+    m_size   = 0;
+    m_mapped = 0;
+    m_mode   = Mode::None;
+}
+
+//
+//  hands the pages of a huge page block back to the system, they read as zero when touched
+//  again. A file mapping would read the file again and a shared segment belongs to other
+//  processes as well, so those are never discarded
+//
+
+bool LargeMemory::discard()
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (!m_data || (m_mode != Mode::HugeTlb1G && m_mode != Mode::HugeTlb2M && m_mode != Mode::Transparent))
+        return false;
+
+    return !madvise(m_data, m_mapped, MADV_DONTNEED);
+#else
+    return false;
+#endif
+}
+
+void LargeMemory::swap(LargeMemory & other)
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_mapped, other.m_mapped);
+    std::swap(m_mode, other.m_mode);
+}
+
+const char * LargeMemory::modeName() const
+{
+    switch (m_mode) {
+    case Mode::HugeTlb1G:   return "1 GB huge pages";
+    case Mode::HugeTlb2M:   return "2 MB huge pages";
+    case Mode::Transparent: return "transparent huge pages";
+    case Mode::Normal:      return "normal pages";
+    case Mode::File:        return "a file mapping";
+    case Mode::Shared:      return "shared memory";
+    default:                return "none";
+    }
+}
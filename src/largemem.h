@@ -0,0 +1,72 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2018-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LARGEMEM_H
+#define LARGEMEM_H
+
+#include <cstddef>
+#include <string>
+
+//
+//  A block of memory backed by the largest pages the system grants. On Linux explicit huge
+//  pages (MAP_HUGETLB, 1 GB then 2 MB) are tried first, then transparent huge pages, then
+//  normal pages. The block is always at least cache line aligned and is released on destruction.
+//
+
+class LargeMemory
+{
+public:
+    enum class Mode
+    {
+        None,
+        HugeTlb1G,   // explicit 1 GB pages from the hugetlbfs pool
+        HugeTlb2M,   // explicit 2 MB pages from the hugetlbfs pool
+        Transparent, // 2 MB aligned block with transparent huge pages requested
+        Normal,      // whatever the default allocator returns
+        File,        // private copy on write mapping of a file
+        Shared       // named POSIX shared memory segment, visible to other processes
+    };
+
+public:
+    LargeMemory();
+    ~LargeMemory();
+    LargeMemory(const LargeMemory&) = delete;
+    LargeMemory& operator=(const LargeMemory&) = delete;
+
+public:
+    bool allocate(size_t size);
+    bool map(const std::string & path, size_t offset, size_t size);
+    bool attach(const std::string & name, size_t size, bool & created);
+    static bool unlink(const std::string & name);
+    void release();
+    bool discard();
+    void swap(LargeMemory & other);
+    void * data() const { return m_data; }
+    size_t size() const { return m_size; }
+    Mode mode() const { return m_mode; }
+    const char * modeName() const;
+
+private:
+    void * m_data;
+    size_t m_size;
+    size_t m_mapped;
+    Mode m_mode;
+};
+
+#endif // LARGEMEM_H
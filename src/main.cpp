@@ -18,6 +18,7 @@
 *  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "cpu.h"
 #include "nnue.h"
 #if defined(PURE_HCE)
 #include "hce.h"
@@ -32,6 +33,13 @@ int main(int argc, const char* argv[])
 {
     static_assert(USE_AVX2 == 1, "AVX2 is the minimum supported build type");
 
+#if defined(USE_DISPATCH)
+    if (!Cpu::hasAvx2()) {
+        std::cout << "Fatal error: AVX2 is the minimum supported cpu" << std::endl;
+        return 1;
+    }
+#endif
+
     //
     //  initialize igel
     //
@@ -60,6 +68,8 @@ int main(int argc, const char* argv[])
 
     if ((argc > 1) && !strcmp(argv[1], "bench"))
         return handler.onBench(argc > 2 ? argv[2] : nullptr, argc > 3 ? argv[3] : nullptr);
+    else if ((argc > 1) && !strcmp(argv[1], "perft"))
+        return handler.onPerft(std::vector<std::string>(argv + 1, argv + argc));
     else
         return handler.handleCommands();
 }
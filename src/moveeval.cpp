@@ -95,6 +95,47 @@
     }
 }
 
+//
+//  MVV/LVA only: the picker runs SEE lazily, on the capture it is about to hand out
+//
+
+/*static */void MoveEval::scoreCaptures(MoveList & mvlist, size_t begin)
+{
+    auto mvSize = mvlist.Size();
+
+    for (size_t j = begin; j < mvSize; ++j)
+    {
+        Move mv = mvlist[j].m_mv;
+        mvlist[j].m_score = s_SortCapture + 10 * (SORT_VALUE[mv.Captured()] + SORT_VALUE[mv.Promotion()]) - SORT_VALUE[mv.Piece()];
+    }
+}
+
+/*static */void MoveEval::scoreQuiets(Search * pSearch, MoveList & mvlist, int ply)
+{
+    auto counterMove = ply >= 1 ? pSearch->m_moveStack[ply - 1] : Move{};
+    auto counterPiece = ply >= 1 ? pSearch->m_pieceStack[ply - 1] : 0;
+    auto counterTo = ply >= 1 ? counterMove.To() : 0;
+
+    auto followMove = ply >= 2 ? pSearch->m_moveStack[ply - 2] : Move{};
+    auto followPiece = ply >= 2 ? pSearch->m_pieceStack[ply - 2] : 0;
+    auto followTo = ply >= 2 ? followMove.To() : 0;
+
+    auto mvSize = mvlist.Size();
+    const auto side = pSearch->m_position.Side();
+
+    for (size_t j = 0; j < mvSize; ++j)
+    {
+        Move mv = mvlist[j].m_mv;
+        mvlist[j].m_score = pSearch->m_history[side][mv.From()][mv.To()];
+
+        if (counterMove)
+            mvlist[j].m_score += pSearch->m_followTable[0][counterPiece][counterTo][mv.Piece()][mv.To()];
+
+        if (followMove)
+            mvlist[j].m_score += pSearch->m_followTable[1][followPiece][followTo][mv.Piece()][mv.To()];
+    }
+}
+
 /*static */Move MoveEval::getNextBest(MoveList & mvlist, size_t i)
 {
     if (i == 0 && mvlist[0].m_score == s_SortHash)
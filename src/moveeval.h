@@ -25,6 +25,8 @@
 
 class MoveEval
 {
+    friend class MovePicker;
+
     MoveEval() = delete;
     ~MoveEval() = delete;
 
@@ -33,15 +35,17 @@ public:
     static bool isSpecialMove(const Move & mv, Search * pSearch);
     static FORCE_INLINE bool isGoodCapture(const Move & mv) { return SORT_VALUE[mv.Captured()] >= SORT_VALUE[mv.Piece()]; }
     static void sortMoves(Search * pSearch, MoveList & mvlist, Move hashMove, int ply);
+    static void scoreCaptures(MoveList & mvlist, size_t begin);
+    static void scoreQuiets(Search * pSearch, MoveList & mvlist, int ply);
     static Move getNextBest(MoveList & mvlist, size_t i);
     static EVAL SEE_Exchange(Search * pSearch, FLD to, COLOR side, EVAL currScore, EVAL target, U64 occ);
     static EVAL SEE(Search * pSearch, const Move & mv);
 
     //
-    // sortMoves already ran SEE for every non-promotion capture and encoded the result
-    // in the sort score: losing captures score s_SortBadCapture + see, winning ones stay
-    // in the capture band. Reuse that instead of a second SEE call. Not valid for the
-    // hash move, which keeps s_SortHash whatever it is.
+    // sortMoves and MovePicker both settle SEE for a non-promotion capture before handing
+    // it out and encode the result in the sort score: losing captures score
+    // s_SortBadCapture + see, winning ones stay in the capture band. Reuse that instead of
+    // a second SEE call. Not valid for the hash move, which keeps s_SortHash whatever it is.
     //
 
     static FORCE_INLINE bool seeCached(const Move & mv, int sortScore) { return mv.Captured() && !mv.Promotion() && sortScore != s_SortHash; }
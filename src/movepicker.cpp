@@ -0,0 +1,222 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "movepicker.h"
+#include "moveeval.h"
+
+MovePicker::MovePicker(Search * pSearch, MoveList & mvlist, Move hashMove, int ply, bool inCheck, bool tacticalOnly/* = false*/) :
+    m_pSearch(pSearch),
+    m_mvlist(mvlist),
+    m_hashMove(hashMove),
+    m_killers{},
+    m_counterMove{},
+    m_ply(ply),
+    m_stage(STAGE_HASH),
+    m_cur(0),
+    m_lastScore(0),
+    m_inCheck(inCheck),
+    m_tacticalOnly(tacticalOnly),
+    m_skipQuiets(false)
+{
+    const auto & pos = pSearch->m_position;
+
+    //
+    //  the hash move comes from a table shared by all threads and may belong to another
+    //  position, so it is validated here instead of by membership in a generated list
+    //
+
+    if (m_hashMove && !(pos.isPseudoLegal(m_hashMove) && pos.isLegal(m_hashMove)))
+        m_hashMove = 0;
+
+    if (m_hashMove && tacticalOnly && !inCheck) {
+        auto promotion = m_hashMove.Promotion();
+        if (!MoveEval::isTacticalMove(m_hashMove) || (promotion && GetPieceType(promotion) != QUEEN))
+            m_hashMove = 0;
+    }
+
+    if (!tacticalOnly && !inCheck) {
+        m_killers[0] = pSearch->m_killerMoves[ply][0];
+        m_killers[1] = pSearch->m_killerMoves[ply][1];
+
+        if (ply >= 1 && pSearch->m_moveStack[ply - 1])
+            m_counterMove = pSearch->m_counterTable[pSearch->m_pieceStack[ply - 1]][pSearch->m_moveStack[ply - 1].To()];
+    }
+}
+
+bool MovePicker::isRefutation(Move mv) const
+{
+    const auto & pos = m_pSearch->m_position;
+    return mv && mv != m_hashMove && !MoveEval::isTacticalMove(mv) && pos.isPseudoLegal(mv) && pos.isLegal(mv);
+}
+
+//
+//  returns the next move to try, or an empty move once every stage is exhausted
+//
+
+Move MovePicker::nextMove()
+{
+    const auto & pos = m_pSearch->m_position;
+
+    for (;;) {
+        switch (m_stage) {
+        case STAGE_HASH:
+            m_stage = m_inCheck ? STAGE_GEN_EVASIONS : STAGE_GEN_CAPTURES;
+
+            if (m_hashMove) {
+                m_lastScore = MoveEval::s_SortHash;
+                return m_hashMove;
+            }
+            break;
+
+        case STAGE_GEN_CAPTURES:
+            GenLegalCaptures(pos, m_mvlist, !m_tacticalOnly);
+            MoveEval::scoreCaptures(m_mvlist, 0);
+            m_cur = 0;
+            m_stage = STAGE_GOOD_CAPTURES;
+            break;
+
+        case STAGE_GOOD_CAPTURES:
+            while (m_cur < m_mvlist.Size()) {
+                Move mv = MoveEval::getNextBest(m_mvlist, m_cur);
+                auto score = m_mvlist[m_cur].m_score;
+
+                //
+                //  everything still in the capture band is unchecked, so once the best
+                //  score drops below it only losing captures remain
+                //
+
+                if (score < MoveEval::s_SortKiller)
+                    break;
+
+                if (mv.Captured() && !mv.Promotion() && !MoveEval::isGoodCapture(mv)) {
+                    auto see = MoveEval::SEE(m_pSearch, mv);
+                    if (see < 0) {
+                        m_mvlist[m_cur].m_score = MoveEval::s_SortBadCapture + see;
+                        continue;
+                    }
+                }
+
+                ++m_cur;
+
+                if (mv == m_hashMove)
+                    continue;
+
+                m_lastScore = score;
+                return mv;
+            }
+
+            m_stage = m_tacticalOnly ? STAGE_BAD_CAPTURES : STAGE_KILLER0;
+            break;
+
+        case STAGE_KILLER0:
+            m_stage = STAGE_KILLER1;
+
+            if (!m_skipQuiets && isRefutation(m_killers[0])) {
+                m_lastScore = MoveEval::s_SortKiller;
+                return m_killers[0];
+            }
+            break;
+
+        case STAGE_KILLER1:
+            m_stage = STAGE_COUNTER;
+
+            if (!m_skipQuiets && m_killers[1] != m_killers[0] && isRefutation(m_killers[1])) {
+                m_lastScore = MoveEval::s_SortKiller;
+                return m_killers[1];
+            }
+            break;
+
+        case STAGE_COUNTER:
+            m_stage = STAGE_BAD_CAPTURES;
+
+            if (!m_skipQuiets && m_counterMove != m_killers[0] && m_counterMove != m_killers[1] && isRefutation(m_counterMove)) {
+                m_lastScore = MoveEval::s_SortCounter;
+                return m_counterMove;
+            }
+            break;
+
+        case STAGE_BAD_CAPTURES:
+            while (m_cur < m_mvlist.Size()) {
+                Move mv = MoveEval::getNextBest(m_mvlist, m_cur);
+                auto score = m_mvlist[m_cur++].m_score;
+
+                if (mv == m_hashMove)
+                    continue;
+
+                m_lastScore = score;
+                return mv;
+            }
+
+            m_stage = m_tacticalOnly ? STAGE_DONE : STAGE_GEN_QUIETS;
+            break;
+
+        case STAGE_GEN_QUIETS:
+            if (m_skipQuiets) {
+                m_stage = STAGE_DONE;
+                break;
+            }
+
+            GenLegalQuiets(pos, m_mvlist);
+            MoveEval::scoreQuiets(m_pSearch, m_mvlist, m_ply);
+            m_cur = 0;
+            m_stage = STAGE_QUIETS;
+            break;
+
+        case STAGE_QUIETS:
+            while (!m_skipQuiets && m_cur < m_mvlist.Size()) {
+                Move mv = MoveEval::getNextBest(m_mvlist, m_cur);
+                auto score = m_mvlist[m_cur++].m_score;
+
+                if (mv == m_hashMove || mv == m_killers[0] || mv == m_killers[1] || mv == m_counterMove)
+                    continue;
+
+                m_lastScore = score;
+                return mv;
+            }
+
+            m_stage = STAGE_DONE;
+            break;
+
+        case STAGE_GEN_EVASIONS:
+            GenLegalEvasions(pos, m_mvlist);
+            MoveEval::sortMoves(m_pSearch, m_mvlist, 0, m_ply);
+            m_cur = 0;
+            m_stage = STAGE_EVASIONS;
+            break;
+
+        case STAGE_EVASIONS:
+            while (m_cur < m_mvlist.Size()) {
+                Move mv = MoveEval::getNextBest(m_mvlist, m_cur);
+                auto score = m_mvlist[m_cur++].m_score;
+
+                if (mv == m_hashMove || (m_skipQuiets && !MoveEval::isTacticalMove(mv)))
+                    continue;
+
+                m_lastScore = score;
+                return mv;
+            }
+
+            m_stage = STAGE_DONE;
+            break;
+
+        default:
+            return Move{};
+        }
+    }
+}
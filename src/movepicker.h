@@ -0,0 +1,79 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOVEPICKER_H
+#define MOVEPICKER_H
+
+#include "moves.h"
+
+class Search;
+
+//
+//  Staged move picker: hands out the hash move, captures, killers, counter move and quiets
+//  one at a time and generates each group only when the previous one is exhausted, so a
+//  cutoff on an early move never pays for generating and scoring the rest.
+//
+
+class MovePicker
+{
+public:
+    MovePicker(Search * pSearch, MoveList & mvlist, Move hashMove, int ply, bool inCheck, bool tacticalOnly = false);
+    MovePicker(const MovePicker&) = delete;
+    MovePicker& operator=(const MovePicker&) = delete;
+
+public:
+    Move nextMove();
+    int lastScore() const { return m_lastScore; }
+    void skipQuiets() { m_skipQuiets = true; }
+
+private:
+    enum Stage
+    {
+        STAGE_HASH,
+        STAGE_GEN_CAPTURES,
+        STAGE_GOOD_CAPTURES,
+        STAGE_KILLER0,
+        STAGE_KILLER1,
+        STAGE_COUNTER,
+        STAGE_BAD_CAPTURES,
+        STAGE_GEN_QUIETS,
+        STAGE_QUIETS,
+        STAGE_GEN_EVASIONS,
+        STAGE_EVASIONS,
+        STAGE_DONE
+    };
+
+    bool isRefutation(Move mv) const;
+
+private:
+    Search * m_pSearch;
+    MoveList & m_mvlist;
+    Move m_hashMove;
+    Move m_killers[2];
+    Move m_counterMove;
+    int m_ply;
+    int m_stage;
+    size_t m_cur;
+    int m_lastScore;
+    bool m_inCheck;
+    bool m_tacticalOnly;
+    bool m_skipQuiets;
+};
+
+#endif // MOVEPICKER_H
@@ -230,7 +230,7 @@ void GenAllMoves(const Position& pos, MoveList& mvlist)
     }
 }
 
-void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist)
+void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist, bool underPromotions/* = false*/)
 {
     mvlist.Clear();
 
@@ -262,6 +262,11 @@ void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist)
         {
             if (row == seventh) {
                 mvlist.Add(from, to, piece, NOPIECE, QW | side);
+                if (underPromotions) {
+                    mvlist.Add(from, to, piece, NOPIECE, RW | side);
+                    mvlist.Add(from, to, piece, NOPIECE, BW | side);
+                    mvlist.Add(from, to, piece, NOPIECE, NW | side);
+                }
             }
         }
 
@@ -272,6 +277,11 @@ void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist)
             captured = pos[to];
             if (row == seventh) {
                 mvlist.Add(from, to, piece, captured, QW | side);
+                if (underPromotions) {
+                    mvlist.Add(from, to, piece, captured, RW | side);
+                    mvlist.Add(from, to, piece, captured, BW | side);
+                    mvlist.Add(from, to, piece, captured, NW | side);
+                }
             }
             else
                 mvlist.Add(from, to, piece, captured);
@@ -377,6 +387,146 @@ void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist)
     }
 }
 
+void GenQuietMoves(const Position& pos, MoveList& mvlist)
+{
+    mvlist.Clear();
+
+    COLOR side = pos.Side();
+    U64 occ = pos.BitsAll();
+    U64 free = ~occ;
+
+    PIECE piece;
+    U64 x, y;
+    FLD from, to;
+
+    //
+    //   PAWNS
+    //
+
+    int fwd = -8 + 16 * side;
+    int second = 6 - 5 * side;
+    int seventh = 1 + 5 * side;
+
+    piece = PW | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        int row = Row(from);
+
+        if (row == seventh)
+            continue;
+
+        to = from + fwd;
+        if (!pos[to])
+        {
+            mvlist.Add(from, to, piece);
+            if (row == second)
+            {
+                to += fwd;
+                if (!pos[to])
+                    mvlist.Add(from, to, piece);
+            }
+        }
+    }
+
+    //
+    //   KNIGHTS
+    //
+
+    piece = KNIGHT | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        y = BB_KNIGHT_ATTACKS[from] & free;
+        while (y)
+        {
+            to = PopLSB(y);
+            mvlist.Add(from, to, piece);
+        }
+    }
+
+    //
+    //   BISHOPS
+    //
+
+    piece = BISHOP | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        y = BishopAttacks(from, occ) & free;
+        while (y)
+        {
+            to = PopLSB(y);
+            mvlist.Add(from, to, piece);
+        }
+    }
+
+    //
+    //   ROOKS
+    //
+
+    piece = ROOK | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        y = RookAttacks(from, occ) & free;
+        while (y)
+        {
+            to = PopLSB(y);
+            mvlist.Add(from, to, piece);
+        }
+    }
+
+    //
+    //   QUEENS
+    //
+
+    piece = QUEEN | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        y = QueenAttacks(from, occ) & free;
+        while (y)
+        {
+            to = PopLSB(y);
+            mvlist.Add(from, to, piece);
+        }
+    }
+
+    //
+    //   KINGS
+    //
+
+    piece = KING | side;
+    from = pos.King(side);
+    y = BB_KING_ATTACKS[from] & free;
+    while (y)
+    {
+        to = PopLSB(y);
+        mvlist.Add(from, to, piece);
+    }
+
+    // castlings
+    if (pos.CanCastle(side, KINGSIDE)) {
+        if (g_uci_chess960)
+            mvlist.Add(Move::Castling(pos.King(side), pos.CastlingRookSq(side, KINGSIDE), KING | side));
+        else
+            mvlist.Add(MOVE_O_O[side]);
+    }
+
+    if (pos.CanCastle(side, QUEENSIDE)) {
+        if (g_uci_chess960)
+            mvlist.Add(Move::Castling(pos.King(side), pos.CastlingRookSq(side, QUEENSIDE), KING | side));
+        else
+            mvlist.Add(MOVE_O_O_O[side]);
+    }
+}
+
 void AddSimpleChecks(const Position& pos, MoveList& mvlist)
 {
     COLOR side = pos.Side();
@@ -681,3 +831,237 @@ void GenMovesInCheck(const Position& pos, MoveList& mvlist)
     }
 }
 
+
+//
+//   LEGAL GENERATION
+//
+//   Pinned pieces and the check mask are computed once per node, so every move added
+//   below is legal and MakeMove never has to take one back. King moves, en passant and
+//   castling are rare enough to be tested one by one with Position::isLegal.
+//
+
+enum
+{
+    GEN_CAPTURES        = 0x01, // captures and queen promotions
+    GEN_UNDERPROMOTIONS = 0x02,
+    GEN_QUIETS          = 0x04  // everything else, castling included
+};
+
+static void GenLegal(const Position& pos, MoveList& mvlist, int flags)
+{
+    mvlist.Clear();
+
+    COLOR side = pos.Side();
+    COLOR opp = side ^ 1;
+    U64 occ = pos.BitsAll();
+    FLD K = pos.King(side);
+
+    PIECE piece, captured;
+    U64 x, y;
+    FLD from, to;
+
+    //
+    //   check and pin masks
+    //
+
+    U64 checkers = pos.GetAttacks(K, opp, occ);
+    U64 checkMask = ~LL(0);
+
+    if (checkers)
+        checkMask = (checkers & (checkers - 1)) ? 0 : checkers | BB_BETWEEN[K][LSB(checkers)];
+
+    U64 pinned = 0;
+    U64 pinRay[64];
+
+    x = (BB_BISHOP_ATTACKS[K] & (pos.Bits(BW | opp) | pos.Bits(QW | opp))) |
+        (BB_ROOK_ATTACKS[K] & (pos.Bits(RW | opp) | pos.Bits(QW | opp)));
+    while (x)
+    {
+        from = PopLSB(x);
+        y = BB_BETWEEN[K][from] & occ;
+        if (y && !(y & (y - 1)) && (y & pos.BitsAll(side)))
+        {
+            to = LSB(y);
+            pinned |= y;
+            pinRay[to] = BB_BETWEEN[K][from] | BB_SINGLE[from];
+        }
+    }
+
+    U64 targets = 0;
+    if (flags & GEN_CAPTURES)
+        targets |= pos.BitsAll(opp);
+    if (flags & GEN_QUIETS)
+        targets |= ~occ;
+
+    //
+    //   KINGS
+    //
+
+    piece = KING | side;
+    y = BB_KING_ATTACKS[K] & targets;
+    while (y)
+    {
+        to = PopLSB(y);
+        Move mv(K, to, piece, pos[to]);
+        if (pos.isLegal(mv))
+            mvlist.Add(mv);
+    }
+
+    if ((flags & GEN_QUIETS) && !checkers)
+    {
+        for (U8 flank : { KINGSIDE, QUEENSIDE })
+        {
+            if (!pos.CanCastle(side, flank))
+                continue;
+
+            Move mv;
+            if (g_uci_chess960)
+                mv = Move::Castling(K, pos.CastlingRookSq(side, flank), KING | side);
+            else
+                mv = flank == KINGSIDE ? MOVE_O_O[side] : MOVE_O_O_O[side];
+
+            if (pos.isLegal(mv))
+                mvlist.Add(mv);
+        }
+    }
+
+    //
+    //   in double check only the king may move
+    //
+
+    if (!checkMask)
+        return;
+
+    //
+    //   PAWNS
+    //
+
+    int fwd = -8 + 16 * side;
+    int second = 6 - 5 * side;
+    int seventh = 1 + 5 * side;
+
+    piece = PW | side;
+    x = pos.Bits(piece);
+    while (x)
+    {
+        from = PopLSB(x);
+        int row = Row(from);
+        U64 legal = checkMask & ((pinned & BB_SINGLE[from]) ? pinRay[from] : ~LL(0));
+
+        to = from + fwd;
+        if (!pos[to])
+        {
+            if (row == seventh)
+            {
+                if (BB_SINGLE[to] & legal)
+                {
+                    if (flags & GEN_CAPTURES)
+                        mvlist.Add(from, to, piece, NOPIECE, QW | side);
+                    if (flags & GEN_UNDERPROMOTIONS)
+                    {
+                        mvlist.Add(from, to, piece, NOPIECE, RW | side);
+                        mvlist.Add(from, to, piece, NOPIECE, BW | side);
+                        mvlist.Add(from, to, piece, NOPIECE, NW | side);
+                    }
+                }
+            }
+            else if (flags & GEN_QUIETS)
+            {
+                if (BB_SINGLE[to] & legal)
+                    mvlist.Add(from, to, piece);
+
+                if (row == second && !pos[to + fwd] && (BB_SINGLE[to + fwd] & legal))
+                    mvlist.Add(from, to + fwd, piece);
+            }
+        }
+
+        if (!(flags & GEN_CAPTURES))
+            continue;
+
+        y = BB_PAWN_ATTACKS[from][side] & pos.BitsAll(opp) & legal;
+        while (y)
+        {
+            to = PopLSB(y);
+            captured = pos[to];
+            if (row == seventh)
+            {
+                mvlist.Add(from, to, piece, captured, QW | side);
+                if (flags & GEN_UNDERPROMOTIONS)
+                {
+                    mvlist.Add(from, to, piece, captured, RW | side);
+                    mvlist.Add(from, to, piece, captured, BW | side);
+                    mvlist.Add(from, to, piece, captured, NW | side);
+                }
+            }
+            else
+                mvlist.Add(from, to, piece, captured);
+        }
+    }
+
+    if ((flags & GEN_CAPTURES) && pos.EP() != NF)
+    {
+        to = pos.EP();
+        y = BB_PAWN_ATTACKS[to][opp] & pos.Bits(piece);
+        while (y)
+        {
+            from = PopLSB(y);
+            Move mv(from, to, piece, piece ^ 1);
+            if (pos.isLegal(mv))
+                mvlist.Add(mv);
+        }
+    }
+
+    //
+    //   PIECES
+    //
+
+    for (PIECE type : { KNIGHT, BISHOP, ROOK, QUEEN })
+    {
+        piece = type | side;
+        x = pos.Bits(piece);
+        while (x)
+        {
+            from = PopLSB(x);
+
+            switch (type)
+            {
+                case KNIGHT: y = BB_KNIGHT_ATTACKS[from];    break;
+                case BISHOP: y = BishopAttacks(from, occ);   break;
+                case ROOK:   y = RookAttacks(from, occ);     break;
+                default:     y = QueenAttacks(from, occ);    break;
+            }
+
+            y &= targets & checkMask;
+            if (pinned & BB_SINGLE[from])
+                y &= pinRay[from];
+
+            while (y)
+            {
+                to = PopLSB(y);
+                captured = pos[to];
+                mvlist.Add(from, to, piece, captured);
+            }
+        }
+    }
+}
+
+void GenLegalMoves(const Position& pos, MoveList& mvlist)
+{
+    GenLegal(pos, mvlist, GEN_CAPTURES | GEN_UNDERPROMOTIONS | GEN_QUIETS);
+}
+
+void GenLegalCaptures(const Position& pos, MoveList& mvlist, bool underPromotions/* = false*/)
+{
+    GenLegal(pos, mvlist, GEN_CAPTURES | (underPromotions ? GEN_UNDERPROMOTIONS : 0));
+}
+
+void GenLegalQuiets(const Position& pos, MoveList& mvlist)
+{
+    GenLegal(pos, mvlist, GEN_QUIETS);
+}
+
+void GenLegalEvasions(const Position& pos, MoveList& mvlist)
+{
+    assert(pos.InCheck());
+    GenLegal(pos, mvlist, GEN_CAPTURES | GEN_UNDERPROMOTIONS | GEN_QUIETS);
+}
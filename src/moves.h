@@ -56,8 +56,13 @@ private:
 };
 
 void GenAllMoves(const Position& pos, MoveList& mvlist);
-void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist);
+void GenCapturesAndPromotions(const Position& pos, MoveList& mvlist, bool underPromotions = false);
+void GenQuietMoves(const Position& pos, MoveList& mvlist);
 void AddSimpleChecks(const Position& pos, MoveList& mvlist);
 void GenMovesInCheck(const Position& pos, MoveList& mvlist);
+void GenLegalMoves(const Position& pos, MoveList& mvlist);
+void GenLegalCaptures(const Position& pos, MoveList& mvlist, bool underPromotions = false);
+void GenLegalQuiets(const Position& pos, MoveList& mvlist);
+void GenLegalEvasions(const Position& pos, MoveList& mvlist);
 
 #endif
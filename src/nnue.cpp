@@ -18,6 +18,7 @@
 */
 
 #include "nnue.h"
+#include "cpu.h"
 #include "position.h"
 #include "hce.h"
 #include "utils.h"
@@ -25,7 +26,11 @@
 #include <streambuf>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <atomic>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 #if !defined(PURE_HCE)
 #include "incbin/incbin.h"
@@ -34,14 +39,59 @@
 INCBIN(EmbeddedNNUE, EVALFILE);
 #endif // _MSC_VER
 
-/*static */std::unique_ptr<Transformer> Evaluator::m_transformer;
-/*static */std::vector<std::unique_ptr<LayeredNetwork>> Evaluator::m_networks;
+/*static */LargeMemory Evaluator::m_weights;
+/*static */Transformer * Evaluator::m_transformer = nullptr;
+/*static */LayeredNetwork * Evaluator::m_networks[LAYERED_NETWORKS] = {};
+/*static */U64 Evaluator::m_networkId = 0;
+
+static_assert(std::is_trivially_destructible<Transformer>::value && std::is_trivially_destructible<LayeredNetwork>::value,
+    "network weights are released together with their block, without running destructors");
 
 // bumped on every network (re)load so per-thread refresh caches drop stale columns
 static std::atomic<int> s_networkGeneration{0};
+
+#if defined(USE_DISPATCH)
+//
+//  a dispatching build carries the kernels of every supported instruction set, built from
+//  nnuesimd.h by nnueavx2.cpp, nnueavx512.cpp and nnuevnni512.cpp, and picks one at startup
+//
+
+extern const NnueKernels NnueKernelsAvx2;
+extern const NnueKernels NnueKernelsAvx512;
+extern const NnueKernels NnueKernelsVnni512;
+
+static const NnueKernels & selectKernels()
+{
+    switch (Cpu::isa()) {
+    case Cpu::Isa::Avx512Vnni:
+        return NnueKernelsVnni512;
+    case Cpu::Isa::Avx512:
+        return NnueKernelsAvx512;
+    default:
+        return NnueKernelsAvx2;
+    }
+}
+
+static const NnueKernels & s_kernels = selectKernels();
+#else
+#define NNUE_SIMD Native
+#include "nnuesimd.h"
+
+static constexpr NnueKernels s_kernels = { &Native::updateAccumulator, &Native::transformFeatures, &Native::propagateNetwork };
+#endif
 #endif // PURE_HCE
 
 EVAL Evaluator::evaluate(Position & pos)
+{
+    return fromRaw(pos, evaluateRaw(pos));
+}
+
+//
+//  the part of the evaluation that depends on the position alone, which is what the hash table
+//  keeps; the fifty move scaling depends on how the position was reached
+//
+
+EVAL Evaluator::evaluateRaw(Position & pos)
 {
 #if defined(PURE_HCE)
     // Pure hand-crafted evaluation, selected at compile time with -DPURE_HCE.
@@ -49,11 +99,40 @@ EVAL Evaluator::evaluate(Position & pos)
     return Hce::evaluate(pos, base);
 #else
     EVAL scale = 600 + 20 * pos.nonPawnMaterial() / 1024;
-    EVAL v = static_cast<EVAL>(NnueEvaluate(pos) * scale / 1024);
+    return static_cast<EVAL>(NnueEvaluate(pos) * scale / 1024);
+#endif
+}
 
-    v = v * (208 - pos.Fifty()) / 208;
+/*static */EVAL Evaluator::fromRaw(const Position & pos, EVAL raw)
+{
+#if defined(PURE_HCE)
+    (void)pos;
+    return raw;
+#else
+    return raw * (208 - pos.Fifty()) / 208 + Tempo;
+#endif
+}
 
-    return v + Tempo;
+/*static */U64 Evaluator::networkId()
+{
+#if defined(PURE_HCE)
+    return 0;
+#else
+    return m_networkId;
+#endif
+}
+
+//
+//  called right after a move is made: starts loading the weight columns the next evaluation
+//  will apply, which are almost always far out of cache
+//
+
+void Evaluator::prefetch(Position & pos)
+{
+#if defined(PURE_HCE)
+    (void)pos;
+#else
+    m_transformer->prefetch(pos);
 #endif
 }
 
@@ -88,14 +167,37 @@ bool Evaluator::initEval()
     architecture.resize(size);
     stream.read(&(architecture)[0], size);
 
-    m_transformer.reset(new Transformer(stream));
-    m_networks.clear();
+    //
+    //  all weights live in one block so the lookups of every evaluation share a few large pages
+    //
+
+    const size_t networksOffset = (sizeof(Transformer) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    if (!m_weights.allocate(networksOffset + LAYERED_NETWORKS * sizeof(LayeredNetwork)))
+        return false;
+
+    auto block = reinterpret_cast<char*>(m_weights.data());
+    m_transformer = new (block) Transformer(stream);
 
     for (auto i = 0; i < LAYERED_NETWORKS; ++i) {
         stream.read(reinterpret_cast<char*>(&version), sizeof(version));
-        m_networks.emplace_back(new LayeredNetwork(stream));
+        m_networks[i] = new (block + networksOffset + i * sizeof(LayeredNetwork)) LayeredNetwork(stream);
     }
 
+    //
+    //  fingerprint of the transformer biases and the layered networks, which differ between any two trained nets
+    //
+
+    auto fnv = [](U64 h, const void * data, size_t size) {
+        auto p = reinterpret_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ p[i]) * 0x100000001b3ull;
+        return h;
+    };
+
+    m_networkId = fnv(0xcbf29ce484222325ull, m_transformer->biases, sizeof(m_transformer->biases));
+    m_networkId = fnv(m_networkId, block + networksOffset, LAYERED_NETWORKS * sizeof(LayeredNetwork));
+
     ++s_networkGeneration;
 
     return stream.good() && stream.peek() == std::ios::traits_type::eof();
@@ -142,7 +244,7 @@ int Evaluator::NnueEvaluate(Position & pos) {
     //
 
     alignas(CACHE_LINE) char buffer[384];
-    auto output = m_networks[bucket]->propagate(features, buffer);
+    auto output = s_kernels.propagate(*m_networks[bucket], features, buffer);
 
     //
     // scale the result
@@ -165,71 +267,24 @@ Transformer::Transformer(std::istream & s) {
     s.read(reinterpret_cast<char*>(psqts), sizeof(psqts));
 }
 
-inline __m256i vec_msb_pack_16(__m256i a, __m256i b) {
-    __m256i compacted = _mm256_packs_epi16(_mm256_srli_epi16(a, 7), _mm256_srli_epi16(b, 7));
-    return _mm256_permute4x64_epi64(compacted, 0b11011000);
-}
-
-#if defined(USE_AVX2)
-inline __m256i affine_acc_256(__m256i acc, __m256i a, __m256i b) {
-#if defined(USE_AVXVNNI)
-    return _mm256_dpbusd_epi32(acc, a, b);
-#else
-    const __m256i ones = _mm256_set1_epi16(1);
-    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
-#endif
-}
-#endif
-
-#if defined(USE_AVX512)
-inline __m512i vec_msb_pack_16_512(__m512i a, __m512i b) {
-    __m512i compacted = _mm512_packs_epi16(_mm512_srli_epi16(a, 7), _mm512_srli_epi16(b, 7));
-    const __m512i idx = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
-    return _mm512_permutexvar_epi64(idx, compacted);
-}
-
-inline __m512i affine_acc_512(__m512i acc, __m512i a, __m512i b) {
-#if defined(USE_VNNI)
-    return _mm512_dpbusd_epi32(acc, a, b);
-#else
-    const __m512i ones = _mm512_set1_epi16(1);
-    return _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(a, b), ones));
-#endif
-}
-#endif
-
-inline __m128i m256_haddx4(__m256i s0, __m256i s1, __m256i s2, __m256i s3, __m128i bias) {
-    s0 = _mm256_hadd_epi32(s0, s1);
-    s2 = _mm256_hadd_epi32(s2, s3);
-    s0 = _mm256_hadd_epi32(s0, s2);
-    const __m128i lo = _mm256_castsi256_si128(s0);
-    const __m128i hi = _mm256_extracti128_si256(s0, 1);
-    return _mm_add_epi32(_mm_add_epi32(lo, hi), bias);
-}
-
-#if defined(USE_AVX512)
-inline __m128i m512_haddx4(__m512i s0, __m512i s1, __m512i s2, __m512i s3, __m128i bias) {
-    const __m256i a0 = _mm256_add_epi32(_mm512_castsi512_si256(s0), _mm512_extracti64x4_epi64(s0, 1));
-    const __m256i a1 = _mm256_add_epi32(_mm512_castsi512_si256(s1), _mm512_extracti64x4_epi64(s1, 1));
-    const __m256i a2 = _mm256_add_epi32(_mm512_castsi512_si256(s2), _mm512_extracti64x4_epi64(s2, 1));
-    const __m256i a3 = _mm256_add_epi32(_mm512_castsi512_si256(s3), _mm512_extracti64x4_epi64(s3, 1));
-    return m256_haddx4(a0, a1, a2, a3, bias);
-}
-#endif
-
 std::int32_t Transformer::transform(Position & pos, std::uint8_t * outBuffer, const std::size_t bucket) {
 
     const auto s = pos.state();
 
     if (!s->accumulator.computed_accumulation) {
-        // Walk back through null-move states (dirty_num==0, not computed) to find a valid base.
-        // Null moves don't move any pieces, so their accumulator == previous accumulator.
-        const Undo* base = s->previous;
-        while (base && !base->accumulator.computed_accumulation && base->dirtyPiece.dirty_num == 0)
+        // Walk back to the nearest computed ancestor: evaluation is skipped at many interior
+        // nodes, so it may be several moves away. Null moves change no pieces and are not counted.
+        const NnueState* base = s->previous;
+        int plies = s->dirtyPiece.dirty_num ? 1 : 0;
+
+        while (base && !base->accumulator.computed_accumulation && plies < MaxCatchUpPlies) {
+            if (base->dirtyPiece.dirty_num)
+                ++plies;
             base = base->previous;
+        }
 
         if (base && base->accumulator.computed_accumulation)
-            incremental(pos, (base != s->previous) ? &base->accumulator : nullptr);
+            incremental(pos, base);
         else
             refresh(pos);
         s->accumulator.computed_accumulation = true;
@@ -242,57 +297,8 @@ std::int32_t Transformer::transform(Position & pos, std::uint8_t * outBuffer, co
     const Color sides[2] = { pos.Side(), !pos.Side() };
     const auto pt = (psqt[static_cast<int>(sides[0])][bucket] - psqt[static_cast<int>(sides[1])][bucket]) / 2;
 
-    for (std::uint32_t side = 0; side < 2; ++side) {
-        std::uint32_t offset = (HalfDimensions / 2) * side;
-
-#if defined(USE_AVX512)
-        constexpr std::uint32_t OutputChunkSize = MAX_CHUNK_SIZE * 2;
-        static_assert((HalfDimensions / 2) % OutputChunkSize == 0);
-        constexpr std::uint32_t NumOutputChunks = HalfDimensions / 2 / OutputChunkSize;
-
-        const __m512i Zero = _mm512_setzero_si512();
-        const __m512i One = _mm512_set1_epi16(127);
-
-        const __m512i* in0 = reinterpret_cast<const __m512i*>(&(acc[sides[side]][0]));
-        const __m512i* in1 = reinterpret_cast<const __m512i*>(&(acc[sides[side]][HalfDimensions / 2]));
-        __m512i* out = reinterpret_cast<__m512i*>(outBuffer + offset);
-
-        for (std::uint32_t j = 0; j < NumOutputChunks; j += 1) {
-            const __m512i sum0a = _mm512_max_epi16(_mm512_min_epi16(in0[j * 2 + 0], One), Zero);
-            const __m512i sum0b = _mm512_max_epi16(_mm512_min_epi16(in0[j * 2 + 1], One), Zero);
-            const __m512i sum1a = _mm512_max_epi16(_mm512_min_epi16(in1[j * 2 + 0], One), Zero);
-            const __m512i sum1b = _mm512_max_epi16(_mm512_min_epi16(in1[j * 2 + 1], One), Zero);
-
-            const __m512i pa = _mm512_mullo_epi16(sum0a, sum1a);
-            const __m512i pb = _mm512_mullo_epi16(sum0b, sum1b);
-
-            out[j] = vec_msb_pack_16_512(pa, pb);
-        }
-#elif defined(USE_AVX2)
-        constexpr std::uint32_t OutputChunkSize = MAX_CHUNK_SIZE;
-        static_assert((HalfDimensions / 2) % OutputChunkSize == 0);
-        constexpr std::uint32_t NumOutputChunks = HalfDimensions / 2 / OutputChunkSize;
-
-        __m256i Zero = _mm256_setzero_si256();
-        __m256i One = _mm256_set1_epi16(127);
-
-        const __m256i* in0 = reinterpret_cast<const __m256i*>(&(acc[sides[side]][0]));
-        const __m256i* in1 = reinterpret_cast<const __m256i*>(&(acc[sides[side]][HalfDimensions / 2]));
-        __m256i* out = reinterpret_cast<__m256i*>(outBuffer + offset);
-
-        for (std::uint32_t j = 0; j < NumOutputChunks; j += 1) {
-            const __m256i sum0a = _mm256_max_epi16(_mm256_min_epi16(in0[j * 2 + 0], One), Zero);
-            const __m256i sum0b = _mm256_max_epi16(_mm256_min_epi16(in0[j * 2 + 1], One), Zero);
-            const __m256i sum1a = _mm256_max_epi16(_mm256_min_epi16(in1[j * 2 + 0], One), Zero);
-            const __m256i sum1b = _mm256_max_epi16(_mm256_min_epi16(in1[j * 2 + 1], One), Zero);
-
-            const __m256i pa = _mm256_mullo_epi16(sum0a, sum1a);
-            const __m256i pb = _mm256_mullo_epi16(sum0b, sum1b);
-
-            out[j] = vec_msb_pack_16(pa, pb);
-        }
-#endif
-    }
+    for (std::uint32_t side = 0; side < 2; ++side)
+        s_kernels.transformFeatures(acc[sides[side]], outBuffer + (HalfDimensions / 2) * side);
 
     return pt;
 }
@@ -378,198 +384,66 @@ static void refreshPerspective(Transformer & t, Position & pos, COLOR c) {
         entry.pieces[i] = newPs;
     }
 
-#if defined(USE_AVX512)
-    using acc_vec_t = __m512i;
-    auto vadd16 = [](acc_vec_t a, acc_vec_t b) { return _mm512_add_epi16(a, b); };
-    auto vsub16 = [](acc_vec_t a, acc_vec_t b) { return _mm512_sub_epi16(a, b); };
-#elif defined(USE_AVX2)
-    using acc_vec_t = __m256i;
-    auto vadd16 = [](acc_vec_t a, acc_vec_t b) { return _mm256_add_epi16(a, b); };
-    auto vsub16 = [](acc_vec_t a, acc_vec_t b) { return _mm256_sub_epi16(a, b); };
-#endif
-
-#if defined(USE_AVX2)
-    const std::uint32_t chunks = Transformer::HalfDimensions / (sizeof(acc_vec_t) / sizeof(std::int16_t));
-    auto cacheAcc = reinterpret_cast<acc_vec_t*>(&entry.accumulation[0]);
-
-    for (std::uint32_t index = 0; index < cr; index++) {
-        std::uint32_t offset = Transformer::HalfDimensions * removed[index];
-
-        {
-            auto* p = reinterpret_cast<__m256i*>(&entry.psqt[0]);
-            *p = _mm256_sub_epi32(*p, _mm256_load_si256(reinterpret_cast<const __m256i*>(&t.psqts[removed[index] * PSQT_BUCKETS])));
-        }
-
-        auto column = reinterpret_cast<const acc_vec_t*>(&t.weights[offset]);
-        for (std::uint32_t j = 0; j < chunks; ++j)
-            cacheAcc[j] = vsub16(cacheAcc[j], column[j]);
-    }
-
-    for (std::uint32_t index = 0; index < ca; index++) {
-        std::uint32_t offset = Transformer::HalfDimensions * added[index];
-
-        {
-            auto* p = reinterpret_cast<__m256i*>(&entry.psqt[0]);
-            *p = _mm256_add_epi32(*p, _mm256_load_si256(reinterpret_cast<const __m256i*>(&t.psqts[added[index] * PSQT_BUCKETS])));
-        }
-
-        auto column = reinterpret_cast<const acc_vec_t*>(&t.weights[offset]);
-        for (std::uint32_t j = 0; j < chunks; ++j)
-            cacheAcc[j] = vadd16(cacheAcc[j], column[j]);
-    }
-#else
-    for (std::uint32_t index = 0; index < cr; index++)
-        for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-            entry.psqt[k] -= t.psqts[removed[index] * PSQT_BUCKETS + k];
-
-    for (std::uint32_t index = 0; index < ca; index++)
-        for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-            entry.psqt[k] += t.psqts[added[index] * PSQT_BUCKETS + k];
-#endif
-
-    std::memcpy(accumulator.accumulation[c], entry.accumulation, Transformer::HalfDimensions * sizeof(std::int16_t));
-
-#if defined(USE_AVX2)
-    _mm256_store_si256(reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]),
-        _mm256_load_si256(reinterpret_cast<const __m256i*>(&entry.psqt[0])));
-#else
-    for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-        accumulator.psqtAccumulation[c][k] = entry.psqt[k];
-#endif
+    s_kernels.updateAccumulator(t, entry.accumulation, entry.accumulation, accumulator.accumulation[c],
+                                entry.psqt, entry.psqt, accumulator.psqtAccumulation[c],
+                                removed, cr, added, ca);
 }
 
-inline void Transformer::incremental(Position & pos, const Accumulator * baseAcc) {
-    const auto & prev_accumulator = baseAcc ? *baseAcc : pos.state()->previous->accumulator;
-    auto & accumulator = pos.state()->accumulator;
-    const auto & dp = pos.state()->dirtyPiece;
-
-    alignas(CACHE_LINE) std::uint32_t added[32];
-    alignas(CACHE_LINE) std::uint32_t removed[32];
+inline void Transformer::incremental(Position & pos, const NnueState * base) {
+    const auto s = pos.state();
+    auto & accumulator = s->accumulator;
 
-    std::pair<std::uint32_t, std::uint32_t> pa;
+    // a move changes at most two features each way
+    alignas(CACHE_LINE) std::uint32_t added[2 * MaxCatchUpPlies];
+    alignas(CACHE_LINE) std::uint32_t removed[2 * MaxCatchUpPlies];
 
     for (COLOR c : { WHITE, BLACK }) {
+        std::uint32_t ca = 0;
+        std::uint32_t cr = 0;
         auto fullUpdate = false;
 
-        if (dp.dirty_num) { // a piece moved
-            fullUpdate = dp.pieceId[0] == PIECE_ID_KING + c;
-            if (!fullUpdate)
-                pa = pos.getChangedIndexes(c, added, removed);
-        }
+        //
+        //  gather the features changed by every move from base to this position
+        //
 
-#if defined(USE_AVX512)
-        using acc_vec_t = __m512i;
-        auto vadd16 = [](acc_vec_t a, acc_vec_t b) { return _mm512_add_epi16(a, b); };
-        auto vsub16 = [](acc_vec_t a, acc_vec_t b) { return _mm512_sub_epi16(a, b); };
-#elif defined(USE_AVX2)
-        using acc_vec_t = __m256i;
-        auto vadd16 = [](acc_vec_t a, acc_vec_t b) { return _mm256_add_epi16(a, b); };
-        auto vsub16 = [](acc_vec_t a, acc_vec_t b) { return _mm256_sub_epi16(a, b); };
-#endif
+        for (auto st = s; st != base; st = st->previous) {
+            const auto & dp = st->dirtyPiece;
 
-#if defined(USE_AVX2)
-        const std::uint32_t chunks = HalfDimensions / (sizeof(acc_vec_t) / sizeof(std::int16_t));
-        auto accumulation = reinterpret_cast<acc_vec_t*>(&accumulator.accumulation[c][0]);
-#endif
+            if (!dp.dirty_num) // a null move
+                continue;
+
+            if (dp.pieceId[0] == PIECE_ID_KING + c) {
+                fullUpdate = true;
+                break;
+            }
+
+            const auto pa = pos.getChangedIndexes(c, dp, added + ca, removed + cr);
+            ca += pa.first;
+            cr += pa.second;
+        }
 
         if (fullUpdate) {
             // a king move invalidates every feature index of this perspective;
             // rebuild it through the per-king-square refresh cache
             refreshPerspective(*this, pos, c);
+            continue;
         }
-        else {
-#if defined(USE_AVX2)
-            // Fast path: fuse copy+sub+add into a single SIMD pass (avoids re-reading accumulation)
-            if (pa.second == 1 && pa.first == 1) {
-                const auto prev_acc = reinterpret_cast<const acc_vec_t*>(&prev_accumulator.accumulation[c][0]);
-                const auto rem_col  = reinterpret_cast<const acc_vec_t*>(&weights[HalfDimensions * removed[0]]);
-                const auto add_col  = reinterpret_cast<const acc_vec_t*>(&weights[HalfDimensions * added[0]]);
-                for (std::uint32_t j = 0; j < chunks; ++j)
-                    accumulation[j] = vadd16(vsub16(prev_acc[j], rem_col[j]), add_col[j]);
-
-                {
-                    const __m256i prev_p = _mm256_load_si256(reinterpret_cast<const __m256i*>(&prev_accumulator.psqtAccumulation[c][0]));
-                    const __m256i rem_p  = _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[removed[0] * PSQT_BUCKETS]));
-                    const __m256i add_p  = _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[added[0]   * PSQT_BUCKETS]));
-                    _mm256_store_si256(reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]),
-                        _mm256_add_epi32(_mm256_sub_epi32(prev_p, rem_p), add_p));
-                }
-            }
-            // Fast path for captures: fuse copy+sub+sub+add into a single SIMD pass
-            else if (pa.second == 2 && pa.first == 1) {
-                const auto prev_acc = reinterpret_cast<const acc_vec_t*>(&prev_accumulator.accumulation[c][0]);
-                const auto rem0     = reinterpret_cast<const acc_vec_t*>(&weights[HalfDimensions * removed[0]]);
-                const auto rem1     = reinterpret_cast<const acc_vec_t*>(&weights[HalfDimensions * removed[1]]);
-                const auto add_col  = reinterpret_cast<const acc_vec_t*>(&weights[HalfDimensions * added[0]]);
-                for (std::uint32_t j = 0; j < chunks; ++j)
-                    accumulation[j] = vadd16(
-                        vsub16(vsub16(prev_acc[j], rem0[j]), rem1[j]),
-                        add_col[j]);
-
-                {
-                    const __m256i prev_p = _mm256_load_si256(reinterpret_cast<const __m256i*>(&prev_accumulator.psqtAccumulation[c][0]));
-                    const __m256i rem0_p = _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[removed[0] * PSQT_BUCKETS]));
-                    const __m256i rem1_p = _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[removed[1] * PSQT_BUCKETS]));
-                    const __m256i add_p  = _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[added[0]   * PSQT_BUCKETS]));
-                    _mm256_store_si256(reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]),
-                        _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(prev_p, rem0_p), rem1_p), add_p));
-                }
-            }
-            else {
-#endif
-            std::memcpy(accumulator.accumulation[c], prev_accumulator.accumulation[c], HalfDimensions * sizeof(std::int16_t));
-
-#if defined(USE_AVX2)
-            _mm256_store_si256(reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]),
-                _mm256_load_si256(reinterpret_cast<const __m256i*>(&prev_accumulator.psqtAccumulation[c][0])));
-#else
-            for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-                accumulator.psqtAccumulation[c][k] = prev_accumulator.psqtAccumulation[c][k];
-#endif
 
-            for (std::uint32_t index = 0; index < pa.second; index++) {
-                std::uint32_t offset = HalfDimensions * removed[index];
+        // a feature added by one move and removed by a later one, or the other way, cancels out
+        for (std::uint32_t i = 0; i < cr; ) {
+            const auto it = std::find(added, added + ca, removed[i]);
 
-#if defined(USE_AVX2)
-                {
-                    auto* p = reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]);
-                    *p = _mm256_sub_epi32(*p, _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[removed[index] * PSQT_BUCKETS])));
-                }
-#else
-                for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-                    accumulator.psqtAccumulation[c][k] -= psqts[removed[index] * PSQT_BUCKETS + k];
-#endif
-
-#if defined(USE_AVX2)
-                auto column = reinterpret_cast<const acc_vec_t*>(&weights[offset]);
-                for (std::uint32_t j = 0; j < chunks; ++j)
-                    accumulation[j] = vsub16(accumulation[j], column[j]);
-#endif
+            if (it != added + ca) {
+                *it = added[--ca];
+                removed[i] = removed[--cr];
             }
-
-            for (std::uint32_t index = 0; index < pa.first; index++) {
-                std::uint32_t offset = HalfDimensions * added[index];
-
-#if defined(USE_AVX2)
-                {
-                    auto* p = reinterpret_cast<__m256i*>(&accumulator.psqtAccumulation[c][0]);
-                    *p = _mm256_add_epi32(*p, _mm256_load_si256(reinterpret_cast<const __m256i*>(&psqts[added[index] * PSQT_BUCKETS])));
-                }
-#else
-                for (std::size_t k = 0; k < PSQT_BUCKETS; ++k)
-                    accumulator.psqtAccumulation[c][k] += psqts[added[index] * PSQT_BUCKETS + k];
-#endif
-
-#if defined(USE_AVX2)
-                auto column = reinterpret_cast<const acc_vec_t*>(&weights[offset]);
-                for (std::uint32_t j = 0; j < chunks; ++j)
-                    accumulation[j] = vadd16(accumulation[j], column[j]);
-#endif
-            }
-#if defined(USE_AVX2)
-            }
-#endif
+            else
+                ++i;
         }
+
+        s_kernels.updateAccumulator(*this, base->accumulator.accumulation[c], accumulator.accumulation[c], nullptr,
+                                    base->accumulator.psqtAccumulation[c], accumulator.psqtAccumulation[c], nullptr,
+                                    removed, cr, added, ca);
     }
 }
 
@@ -578,209 +452,58 @@ inline void Transformer::refresh(Position & pos) {
     refreshPerspective(*this, pos, BLACK);
 }
 
-template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
-Layer<OutputDimensions, InputDimensions>::Layer(std::istream & s) {
-    memset(biases, 0, sizeof(biases));
-    memset(weights, 0, sizeof(weights));
-
-    s.read(reinterpret_cast<char*>(biases), sizeof(biases));
-    s.read(reinterpret_cast<char*>(weights), sizeof(weights));
-}
+void Transformer::prefetch(Position & pos) const {
+    const auto & dp = pos.state()->dirtyPiece;
 
-template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
-inline std::int32_t * Layer<OutputDimensions, InputDimensions>::propagate(std::uint8_t * features, char * outBuffer) {
-
-    auto output = reinterpret_cast<std::int32_t*>(outBuffer);
-
-#if defined(USE_AVX512)
-    if constexpr (InputDimensions % (SIMD_WIDTH * 2) == 0) {
-        const std::uint32_t chunks = InputDimensions / (SIMD_WIDTH * 2);
-        const auto input_vector = reinterpret_cast<const __m512i*>(features);
-
-        if constexpr (OutputDimensions % 4 == 0 && InputDimensions >= 128) {
-            for (std::uint32_t i = 0; i < OutputDimensions; i += 4) {
-                __m512i s0 = _mm512_setzero_si512();
-                __m512i s1 = _mm512_setzero_si512();
-                __m512i s2 = _mm512_setzero_si512();
-                __m512i s3 = _mm512_setzero_si512();
-                const auto r0 = reinterpret_cast<const __m512i*>(&weights[(i+0) * InputDimensions]);
-                const auto r1 = reinterpret_cast<const __m512i*>(&weights[(i+1) * InputDimensions]);
-                const auto r2 = reinterpret_cast<const __m512i*>(&weights[(i+2) * InputDimensions]);
-                const auto r3 = reinterpret_cast<const __m512i*>(&weights[(i+3) * InputDimensions]);
-                for (std::uint32_t j = 0; j < chunks; ++j) {
-                    const __m512i inp = _mm512_loadu_si512(&input_vector[j]);
-                    s0 = affine_acc_512(s0, inp, _mm512_loadu_si512(&r0[j]));
-                    s1 = affine_acc_512(s1, inp, _mm512_loadu_si512(&r1[j]));
-                    s2 = affine_acc_512(s2, inp, _mm512_loadu_si512(&r2[j]));
-                    s3 = affine_acc_512(s3, inp, _mm512_loadu_si512(&r3[j]));
-                }
-                const __m128i bias = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&biases[i]));
-                _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), m512_haddx4(s0, s1, s2, s3, bias));
-            }
-            return output;
-        }
+    std::uint32_t indexes[4];
 
-        for (std::uint32_t i = 0; i < OutputDimensions; ++i) {
-            __m512i sum = _mm512_setzero_si512();
-            const auto row = reinterpret_cast<const __m512i*>(&weights[i * InputDimensions]);
-            for (std::uint32_t j = 0; j < chunks; ++j)
-                sum = affine_acc_512(sum, _mm512_loadu_si512(&input_vector[j]), _mm512_loadu_si512(&row[j]));
-            output[i] = _mm512_reduce_add_epi32(sum) + biases[i];
-        }
-        return output;
-    }
-#endif
+    for (COLOR c : { WHITE, BLACK }) {
+        if (dp.pieceId[0] == PIECE_ID_KING + c) // the perspective is rebuilt through the refresh cache
+            continue;
 
-#if defined(USE_AVX2)
-    std::uint32_t chunks = InputDimensions / SIMD_WIDTH;
-    const auto input_vector = reinterpret_cast<const __m256i*>(features);
-#endif
+        const auto pa = pos.getChangedIndexes(c, dp, indexes, indexes + 2);
 
-#if defined(USE_AVX2)
-    // 4-way kernel blocking: process 4 output neurons simultaneously.
-    // 4 independent accumulator chains allow better ILP vs. one serial chain per output.
-    // Threshold is one full SIMD chunk so the small 32x32 hidden layer also takes this path,
-    // where batching the four reductions is a bigger win than the dot-product itself.
-    if constexpr (OutputDimensions % 4 == 0 && InputDimensions >= 32) {
-        for (std::uint32_t i = 0; i < OutputDimensions; i += 4) {
-            __m256i s0 = _mm256_setzero_si256();
-            __m256i s1 = _mm256_setzero_si256();
-            __m256i s2 = _mm256_setzero_si256();
-            __m256i s3 = _mm256_setzero_si256();
-            const auto r0 = reinterpret_cast<const __m256i*>(&weights[(i+0) * InputDimensions]);
-            const auto r1 = reinterpret_cast<const __m256i*>(&weights[(i+1) * InputDimensions]);
-            const auto r2 = reinterpret_cast<const __m256i*>(&weights[(i+2) * InputDimensions]);
-            const auto r3 = reinterpret_cast<const __m256i*>(&weights[(i+3) * InputDimensions]);
-            for (std::uint32_t j = 0; j < chunks; ++j) {
-                const __m256i inp = _mm256_loadA_si256(&input_vector[j]);
-                s0 = affine_acc_256(s0, inp, _mm256_load_si256(&r0[j]));
-                s1 = affine_acc_256(s1, inp, _mm256_load_si256(&r1[j]));
-                s2 = affine_acc_256(s2, inp, _mm256_load_si256(&r2[j]));
-                s3 = affine_acc_256(s3, inp, _mm256_load_si256(&r3[j]));
-            }
-            const __m128i bias = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&biases[i]));
-            _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), m256_haddx4(s0, s1, s2, s3, bias));
-        }
-        return output;
-    }
-#endif
+        for (std::uint32_t i = 0; i < pa.first + pa.second; ++i) {
+            const auto index = i < pa.first ? indexes[i] : indexes[2 + i - pa.first];
+            const auto column = reinterpret_cast<const char*>(&weights[HalfDimensions * index]);
 
-    for (std::uint32_t i = 0; i < OutputDimensions; ++i) {
-        const std::uint32_t offset = i * InputDimensions;
+            for (std::size_t offset = 0; offset < HalfDimensions * sizeof(std::int16_t); offset += CACHE_LINE)
+                ::prefetch(const_cast<char*>(column + offset));
 
-#if defined(USE_AVX2)
-        __m256i sum = _mm256_setzero_si256();
-        const auto row = reinterpret_cast<const __m256i*>(&weights[offset]);
-        for (std::uint32_t j = 0; j < chunks; ++j) {
-            sum = affine_acc_256(sum, _mm256_loadA_si256(&input_vector[j]), _mm256_load_si256(&row[j]));
+            ::prefetch(const_cast<std::int32_t*>(&psqts[index * PSQT_BUCKETS]));
         }
-        __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
-        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_BADC));
-        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_CDAB));
-        output[i] = _mm_cvtsi128_si32(sum128) + biases[i];
-#endif
     }
-
-    return output;
 }
 
-LayeredNetwork::LayeredNetwork(std::istream & s) : inputLayer(s), hiddenLayer1(s), hiddenLayer2(s) {
-}
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
+Layer<OutputDimensions, InputDimensions>::Layer(std::istream & s) {
+    memset(biases, 0, sizeof(biases));
+    memset(weights, 0, sizeof(weights));
 
-inline std::int32_t * LayeredNetwork::propagate(std::uint8_t * features, char * outBuffer) {
-    auto ret = inputLayer.propagate(features, outBuffer + 320);                 // forward propagation
-    auto fc_0_out = ret[15];
-    char ac_sqr_0_out[32] = { 0 };
-    ClippedReLU<6, 16>::propagateSqrt(ret, ac_sqr_0_out);                       // clip
-    char ac_out[32];
-    auto clipped = ClippedReLU<6, 16>::propagate(ret, ac_out);
-    std::memcpy(ac_sqr_0_out + 15, ac_out, 15);
-    ret = hiddenLayer1.propagate((std::uint8_t*)ac_sqr_0_out, outBuffer + 128); // forward propagation
-    clipped = ClippedReLU<6, 32>::propagate(ret, outBuffer + 64);               // clip
-    ret = hiddenLayer2.propagate(clipped, outBuffer);                           // forward propagation
-
-    std::int32_t fwdOut = int(fc_0_out) * (600 * 16) / (127 * (1 << 6));
-    std::int32_t outputValue = ret[0] + fwdOut;
-    ret[0] = outputValue;
-
-    return ret;
+    s.read(reinterpret_cast<char*>(biases), sizeof(biases));
+    s.read(reinterpret_cast<char*>(weights), sizeof(weights));
 }
 
-template <std::int32_t WeightScaleBits, std::int32_t InputDimensions>
-inline std::uint8_t* ClippedReLU<WeightScaleBits, InputDimensions>::propagate(std::int32_t* features, char* outBuffer) {
-
-    auto output = reinterpret_cast<uint8_t*>(outBuffer);
-
-#if defined(USE_AVX2)
-    auto chunks = InputDimensions / SIMD_WIDTH;
-    const __m256i zero = _mm256_setzero_si256();
-    const __m256i offsets = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
-    const auto in = reinterpret_cast<const __m256i*>(features);
-    const auto out = reinterpret_cast<__m256i*>(output);
-
-    for (auto i = 0; i < chunks; ++i) {
-        const __m256i words0 = _mm256_srai_epi16(_mm256_packs_epi32(_mm256_loadA_si256(&in[i * 4 + 0]), _mm256_loadA_si256(&in[i * 4 + 1])), WeightScaleBits);
-        const __m256i words1 = _mm256_srai_epi16(_mm256_packs_epi32(_mm256_loadA_si256(&in[i * 4 + 2]), _mm256_loadA_si256(&in[i * 4 + 3])), WeightScaleBits);
-        _mm256_storeA_si256(&out[i], _mm256_permutevar8x32_epi32(_mm256_max_epi8(_mm256_packs_epi16(words0, words1), zero), offsets));
-    }
-#endif
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
+SparseLayer<OutputDimensions, InputDimensions>::SparseLayer(std::istream & s) {
+    memset(biases, 0, sizeof(biases));
+    memset(weights, 0, sizeof(weights));
 
-    std::uint32_t start = chunks * SIMD_WIDTH;
+    s.read(reinterpret_cast<char*>(biases), sizeof(biases));
 
-    for (std::uint32_t i = start; i < InputDimensions; ++i)
-        output[i] = static_cast<std::uint8_t>(std::max(0, std::min(127, features[i] >> WeightScaleBits)));
+    //
+    //  the network stores the weights by output row, regroup them by input chunk
+    //
 
-    return output;
-}
+    std::vector<std::int8_t> rows(OutputDimensions * InputDimensions, 0);
+    s.read(reinterpret_cast<char*>(rows.data()), rows.size());
 
-template <std::int32_t WeightScaleBits, std::int32_t InputDimensions>
-inline std::uint8_t* ClippedReLU<WeightScaleBits, InputDimensions>::propagateSqrt(std::int32_t* features, char* outBuffer)
-{
-    auto output = reinterpret_cast<uint8_t*>(outBuffer);
-
-#if defined(USE_AVX2)
-    if constexpr (InputDimensions == 16) {
-        const auto in_vec = reinterpret_cast<const __m256i*>(features);
-        __m256i v0 = _mm256_load_si256(&in_vec[0]);   // features[0..7]
-        __m256i v1 = _mm256_load_si256(&in_vec[1]);   // features[8..15]
-
-        // Clamp to [-46340, 46340]: 46340^2 = 2,147,388,400 < INT32_MAX, no overflow in mullo_epi32
-        const __m256i clamp_lo = _mm256_set1_epi32(-46340);
-        const __m256i clamp_hi = _mm256_set1_epi32(46340);
-        v0 = _mm256_min_epi32(_mm256_max_epi32(v0, clamp_lo), clamp_hi);
-        v1 = _mm256_min_epi32(_mm256_max_epi32(v1, clamp_lo), clamp_hi);
-
-        // Square (no int32 overflow after clamp)
-        v0 = _mm256_mullo_epi32(v0, v0);
-        v1 = _mm256_mullo_epi32(v1, v1);
-
-        // Shift right by 2*WeightScaleBits+7: equivalent to >>WeightScaleBits*2 then /128
-        v0 = _mm256_srli_epi32(v0, 2 * WeightScaleBits + 7);
-        v1 = _mm256_srli_epi32(v1, 2 * WeightScaleBits + 7);
-
-        // Clamp to [0, 127]: values are non-negative (squares), only upper bound needed
-        const __m256i out_max = _mm256_set1_epi32(127);
-        v0 = _mm256_min_epi32(v0, out_max);
-        v1 = _mm256_min_epi32(v1, out_max);
-
-        // Pack int32->int16->uint8, fixing AVX2 lane interleaving with a permute
-        __m256i packed16 = _mm256_permute4x64_epi64(
-            _mm256_packs_epi32(v0, v1), 0b11011000);   // reorders to [v0[0..7], v1[0..7]]
-
-        __m256i packed8 = _mm256_packus_epi16(packed16, _mm256_setzero_si256());
-        // Layout: [v0[0..7] | zeros | v1[0..7] | zeros]; combine the two halves:
-        __m128i combined = _mm_unpacklo_epi64(
-            _mm256_castsi256_si128(packed8),
-            _mm256_extracti128_si256(packed8, 1));      // [v0[0..7], v1[0..7]] = 16 bytes
-
-        _mm_storeu_si128(reinterpret_cast<__m128i*>(outBuffer), combined);
-        return output;
+    for (std::int32_t i = 0; i < OutputDimensions; ++i) {
+        for (std::int32_t j = 0; j < InputDimensions; ++j)
+            weights[(j / ChunkSize) * OutputDimensions * ChunkSize + i * ChunkSize + j % ChunkSize] = rows[i * InputDimensions + j];
     }
-#endif
-
-    for (std::uint32_t i = 0; i < InputDimensions; ++i)
-        output[i] = static_cast<std::uint8_t>(std::max(0ll, std::min(127ll, (((long long)features[i] * features[i]) >> (2 * WeightScaleBits)) / 128)));
+}
 
-    return output;
+LayeredNetwork::LayeredNetwork(std::istream & s) : inputLayer(s), hiddenLayer1(s), hiddenLayer2(s) {
 }
 #endif // PURE_HCE
\ No newline at end of file
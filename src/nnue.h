@@ -25,10 +25,12 @@
 #include <cstdint>
 #include <immintrin.h>
 
+#include "largemem.h"
 #include "types.h"
 
 class Position;
 struct Accumulator;
+struct NnueState;
 
 const EVAL VAL_P = 100;
 const EVAL VAL_N = 310;
@@ -57,11 +59,13 @@ public:
 public:
     std::int32_t transform(Position & pos, std::uint8_t * outBuffer, const std::size_t bucket);
     inline void refresh(Position & pos);
-    inline void incremental(Position & pos, const Accumulator * baseAcc = nullptr);
+    inline void incremental(Position & pos, const NnueState * base);
+    void prefetch(Position & pos) const;
 
 public:
     static constexpr int HalfDimensions  = 1024;
     static constexpr int InputDimensions = 22528;
+    static constexpr int MaxCatchUpPlies = 8; // moves an accumulator is brought forward over before it is refreshed instead
 
 public:
     alignas(CACHE_LINE) int16_t biases[HalfDimensions];
@@ -69,21 +73,29 @@ public:
     alignas(CACHE_LINE) int32_t psqts[InputDimensions  * PSQT_BUCKETS];
 };
 
-template <std::int32_t WeightScaleBits, std::int32_t InputDimensions> class ClippedReLU {
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions> class Layer {
+public:
+    Layer(std::istream & s);
 
 public:
-    inline static std::uint8_t * propagate(std::int32_t * features, char * outBuffer);
-    inline static std::uint8_t * propagateSqrt(std::int32_t* features, char* outBuffer);
+    alignas(CACHE_LINE) std::int32_t biases[OutputDimensions];
+    alignas(CACHE_LINE) std::int8_t  weights[OutputDimensions * InputDimensions];
 };
 
-template <std::int32_t OutputDimensions, std::int32_t InputDimensions> class Layer {
+//
+//  Layer over the transformed features, most of which are zero after the clipped product. The
+//  weights are stored by 4-byte input chunks, so each non-zero chunk adds one contiguous column
+//  of OutputDimensions * 4 weights and the zero ones are never touched
+//
+
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions> class SparseLayer {
 public:
-    Layer(std::istream & s);
+    SparseLayer(std::istream & s);
 
 public:
-    inline std::int32_t * propagate(std::uint8_t * features, char * outBuffer);
+    static constexpr std::int32_t ChunkSize = 4;
+    static constexpr std::int32_t NumChunks = InputDimensions / ChunkSize;
 
-private:
     alignas(CACHE_LINE) std::int32_t biases[OutputDimensions];
     alignas(CACHE_LINE) std::int8_t  weights[OutputDimensions * InputDimensions];
 };
@@ -94,28 +106,47 @@ public:
     LayeredNetwork(std::istream & s);
 
 public:
-    inline std::int32_t* propagate(std::uint8_t * features, char * outBuffer);
-
-public:
-    alignas(CACHE_LINE) Layer<16, 1024> inputLayer;
+    alignas(CACHE_LINE) SparseLayer<16, 1024> inputLayer;
     alignas(CACHE_LINE) Layer<32, 32> hiddenLayer1;
     alignas(CACHE_LINE) Layer<1, 32> hiddenLayer2;
 };
 
+//
+//  entry points of the SIMD kernels in nnuesimd.h, one set per instruction set the build carries
+//
+
+struct NnueKernels
+{
+    void (*updateAccumulator)(const Transformer & t,
+                              const std::int16_t * from, std::int16_t * to, std::int16_t * copy,
+                              const std::int32_t * fromPsqt, std::int32_t * toPsqt, std::int32_t * copyPsqt,
+                              const std::uint32_t * removed, std::uint32_t cr,
+                              const std::uint32_t * added, std::uint32_t ca);
+    void (*transformFeatures)(const std::int16_t * accumulation, std::uint8_t * outBuffer);
+    std::int32_t * (*propagate)(const LayeredNetwork & network, std::uint8_t * features, char * outBuffer);
+};
+
 class Evaluator
 {
 public:
     static bool initEval();
     static bool initEval(std::istream & stream);
     static bool setEvalFile(const std::string & evalFile);
+    static const char * weightsPages() { return m_weights.modeName(); }
+    static U64 networkId();
+    void prefetch(Position & pos);
     EVAL evaluate(Position & pos);
+    EVAL evaluateRaw(Position & pos);
+    static EVAL fromRaw(const Position & pos, EVAL raw);
 
 private:
     int NnueEvaluate(Position & pos);
 
 private:
-    static std::unique_ptr<Transformer> m_transformer;
-    static std::vector<std::unique_ptr<LayeredNetwork>> m_networks;
+    static LargeMemory m_weights; // the transformer followed by the layered networks
+    static Transformer * m_transformer;
+    static LayeredNetwork * m_networks[LAYERED_NETWORKS];
+    static U64 m_networkId;
 
 public:
     static constexpr int Tempo = 20;
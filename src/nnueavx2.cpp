@@ -0,0 +1,33 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2023 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+//  AVX2 kernels of a dispatching build, see nnuesimd.h
+//
+
+#if defined(USE_DISPATCH) && !defined(PURE_HCE)
+
+#include "nnue.h"
+
+#define NNUE_SIMD Avx2
+#include "nnuesimd.h"
+
+extern const NnueKernels NnueKernelsAvx2 = { &Avx2::updateAccumulator, &Avx2::transformFeatures, &Avx2::propagateNetwork };
+
+#endif
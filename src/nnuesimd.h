@@ -0,0 +1,607 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2023 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+//  SIMD kernels of the network evaluation. The includer selects the instruction set with the
+//  USE_AVX2, USE_AVX512, USE_VNNI and USE_AVXVNNI macros and names the namespace the kernels
+//  go to with NNUE_SIMD, so a dispatching build can compile them once per instruction set.
+//  nnue.h and <immintrin.h> must be included first; everything here has internal linkage so
+//  that no code built for a wider instruction set can be shared with the rest of the engine
+//
+
+#if !defined(NNUE_SIMD)
+#error NNUE_SIMD must name the namespace of the kernels
+#endif
+
+namespace NNUE_SIMD {
+
+static inline __m256i vec_msb_pack_16(__m256i a, __m256i b) {
+    __m256i compacted = _mm256_packs_epi16(_mm256_srli_epi16(a, 7), _mm256_srli_epi16(b, 7));
+    return _mm256_permute4x64_epi64(compacted, 0b11011000);
+}
+
+// plain functions rather than lambdas, whose function pointer thunks gcc builds without the target of the file
+static inline __m256i vadd16(__m256i a, __m256i b) { return _mm256_add_epi16(a, b); }
+static inline __m256i vsub16(__m256i a, __m256i b) { return _mm256_sub_epi16(a, b); }
+
+#if defined(USE_AVX512)
+static inline __m512i vadd16(__m512i a, __m512i b) { return _mm512_add_epi16(a, b); }
+static inline __m512i vsub16(__m512i a, __m512i b) { return _mm512_sub_epi16(a, b); }
+#endif
+
+#if defined(USE_AVX2)
+static inline __m256i affine_acc_256(__m256i acc, __m256i a, __m256i b) {
+#if defined(USE_AVXVNNI)
+    return _mm256_dpbusd_epi32(acc, a, b);
+#else
+    const __m256i ones = _mm256_set1_epi16(1);
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
+#endif
+}
+#endif
+
+#if defined(USE_AVX512)
+static inline __m512i vec_msb_pack_16_512(__m512i a, __m512i b) {
+    __m512i compacted = _mm512_packs_epi16(_mm512_srli_epi16(a, 7), _mm512_srli_epi16(b, 7));
+    const __m512i idx = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+    return _mm512_permutexvar_epi64(idx, compacted);
+}
+
+static inline __m512i affine_acc_512(__m512i acc, __m512i a, __m512i b) {
+#if defined(USE_VNNI)
+    return _mm512_dpbusd_epi32(acc, a, b);
+#else
+    const __m512i ones = _mm512_set1_epi16(1);
+    return _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(a, b), ones));
+#endif
+}
+#endif
+
+static inline __m128i m256_haddx4(__m256i s0, __m256i s1, __m256i s2, __m256i s3, __m128i bias) {
+    s0 = _mm256_hadd_epi32(s0, s1);
+    s2 = _mm256_hadd_epi32(s2, s3);
+    s0 = _mm256_hadd_epi32(s0, s2);
+    const __m128i lo = _mm256_castsi256_si128(s0);
+    const __m128i hi = _mm256_extracti128_si256(s0, 1);
+    return _mm_add_epi32(_mm_add_epi32(lo, hi), bias);
+}
+
+#if defined(USE_AVX512)
+static inline __m128i m512_haddx4(__m512i s0, __m512i s1, __m512i s2, __m512i s3, __m128i bias) {
+    const __m256i a0 = _mm256_add_epi32(_mm512_castsi512_si256(s0), _mm512_extracti64x4_epi64(s0, 1));
+    const __m256i a1 = _mm256_add_epi32(_mm512_castsi512_si256(s1), _mm512_extracti64x4_epi64(s1, 1));
+    const __m256i a2 = _mm256_add_epi32(_mm512_castsi512_si256(s2), _mm512_extracti64x4_epi64(s2, 1));
+    const __m256i a3 = _mm256_add_epi32(_mm512_castsi512_si256(s3), _mm512_extracti64x4_epi64(s3, 1));
+    return m256_haddx4(a0, a1, a2, a3, bias);
+}
+#endif
+
+//
+//  clipped pairwise product of the two halves of one perspective's accumulator
+//
+
+static void transformFeatures(const std::int16_t * accumulation, std::uint8_t * outBuffer) {
+
+    constexpr std::uint32_t HalfDimensions = Transformer::HalfDimensions;
+
+#if defined(USE_AVX512)
+    constexpr std::uint32_t OutputChunkSize = MAX_CHUNK_SIZE * 2;
+    static_assert((HalfDimensions / 2) % OutputChunkSize == 0);
+    constexpr std::uint32_t NumOutputChunks = HalfDimensions / 2 / OutputChunkSize;
+
+    const __m512i Zero = _mm512_setzero_si512();
+    const __m512i One = _mm512_set1_epi16(127);
+
+    const __m512i* in0 = reinterpret_cast<const __m512i*>(&accumulation[0]);
+    const __m512i* in1 = reinterpret_cast<const __m512i*>(&accumulation[HalfDimensions / 2]);
+    __m512i* out = reinterpret_cast<__m512i*>(outBuffer);
+
+    for (std::uint32_t j = 0; j < NumOutputChunks; j += 1) {
+        const __m512i sum0a = _mm512_max_epi16(_mm512_min_epi16(in0[j * 2 + 0], One), Zero);
+        const __m512i sum0b = _mm512_max_epi16(_mm512_min_epi16(in0[j * 2 + 1], One), Zero);
+        const __m512i sum1a = _mm512_max_epi16(_mm512_min_epi16(in1[j * 2 + 0], One), Zero);
+        const __m512i sum1b = _mm512_max_epi16(_mm512_min_epi16(in1[j * 2 + 1], One), Zero);
+
+        const __m512i pa = _mm512_mullo_epi16(sum0a, sum1a);
+        const __m512i pb = _mm512_mullo_epi16(sum0b, sum1b);
+
+        out[j] = vec_msb_pack_16_512(pa, pb);
+    }
+#elif defined(USE_AVX2)
+    constexpr std::uint32_t OutputChunkSize = MAX_CHUNK_SIZE;
+    static_assert((HalfDimensions / 2) % OutputChunkSize == 0);
+    constexpr std::uint32_t NumOutputChunks = HalfDimensions / 2 / OutputChunkSize;
+
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i One = _mm256_set1_epi16(127);
+
+    const __m256i* in0 = reinterpret_cast<const __m256i*>(&accumulation[0]);
+    const __m256i* in1 = reinterpret_cast<const __m256i*>(&accumulation[HalfDimensions / 2]);
+    __m256i* out = reinterpret_cast<__m256i*>(outBuffer);
+
+    for (std::uint32_t j = 0; j < NumOutputChunks; j += 1) {
+        const __m256i sum0a = _mm256_max_epi16(_mm256_min_epi16(in0[j * 2 + 0], One), Zero);
+        const __m256i sum0b = _mm256_max_epi16(_mm256_min_epi16(in0[j * 2 + 1], One), Zero);
+        const __m256i sum1a = _mm256_max_epi16(_mm256_min_epi16(in1[j * 2 + 0], One), Zero);
+        const __m256i sum1b = _mm256_max_epi16(_mm256_min_epi16(in1[j * 2 + 1], One), Zero);
+
+        const __m256i pa = _mm256_mullo_epi16(sum0a, sum1a);
+        const __m256i pb = _mm256_mullo_epi16(sum0b, sum1b);
+
+        out[j] = vec_msb_pack_16(pa, pb);
+    }
+#endif
+}
+
+//
+// Applies the removed and added feature columns to an accumulator one tile at a time: a tile
+// of TILE_HEIGHT values is loaded into registers, every changed column is folded into it and
+// it is stored once, so the accumulator crosses memory once however many features changed.
+// The PSQT buckets are handled the same way. `copy`, when given, receives the result as well
+//
+
+static void updateAccumulator(const Transformer & t,
+                              const std::int16_t * from, std::int16_t * to, std::int16_t * copy,
+                              const std::int32_t * fromPsqt, std::int32_t * toPsqt, std::int32_t * copyPsqt,
+                              const std::uint32_t * removed, std::uint32_t cr,
+                              const std::uint32_t * added, std::uint32_t ca) {
+
+    static_assert(Transformer::HalfDimensions % TILE_HEIGHT == 0);
+    static_assert(PSQT_BUCKETS % PSQT_TILE_HEIGHT == 0);
+
+#if defined(USE_AVX512)
+    using acc_vec_t = __m512i;
+#elif defined(USE_AVX2)
+    using acc_vec_t = __m256i;
+#endif
+
+#if defined(USE_AVX2)
+    constexpr std::uint32_t TileRegs = TILE_HEIGHT / (sizeof(acc_vec_t) / sizeof(std::int16_t));
+    static_assert(TileRegs <= NUM_REGS, "a tile must fit in the vector registers");
+    static_assert(PSQT_TILE_HEIGHT == NUM_PSQT_REGS * sizeof(__m256i) / sizeof(std::int32_t));
+
+    acc_vec_t regs[TileRegs];
+
+    for (std::uint32_t tile = 0; tile < Transformer::HalfDimensions / TILE_HEIGHT; ++tile) {
+        const std::uint32_t base = tile * TILE_HEIGHT;
+        auto in = reinterpret_cast<const acc_vec_t*>(&from[base]);
+
+        for (std::uint32_t k = 0; k < TileRegs; ++k)
+            regs[k] = in[k];
+
+        for (std::uint32_t index = 0; index < cr; ++index) {
+            auto column = reinterpret_cast<const acc_vec_t*>(&t.weights[Transformer::HalfDimensions * removed[index] + base]);
+            for (std::uint32_t k = 0; k < TileRegs; ++k)
+                regs[k] = vsub16(regs[k], column[k]);
+        }
+
+        for (std::uint32_t index = 0; index < ca; ++index) {
+            auto column = reinterpret_cast<const acc_vec_t*>(&t.weights[Transformer::HalfDimensions * added[index] + base]);
+            for (std::uint32_t k = 0; k < TileRegs; ++k)
+                regs[k] = vadd16(regs[k], column[k]);
+        }
+
+        auto out = reinterpret_cast<acc_vec_t*>(&to[base]);
+        for (std::uint32_t k = 0; k < TileRegs; ++k)
+            out[k] = regs[k];
+
+        if (copy) {
+            auto out2 = reinterpret_cast<acc_vec_t*>(&copy[base]);
+            for (std::uint32_t k = 0; k < TileRegs; ++k)
+                out2[k] = regs[k];
+        }
+    }
+
+    __m256i psqtRegs[NUM_PSQT_REGS];
+
+    for (std::uint32_t tile = 0; tile < PSQT_BUCKETS / PSQT_TILE_HEIGHT; ++tile) {
+        const std::uint32_t base = tile * PSQT_TILE_HEIGHT;
+        auto in = reinterpret_cast<const __m256i*>(&fromPsqt[base]);
+
+        for (std::uint32_t k = 0; k < NUM_PSQT_REGS; ++k)
+            psqtRegs[k] = _mm256_load_si256(&in[k]);
+
+        for (std::uint32_t index = 0; index < cr; ++index) {
+            auto column = reinterpret_cast<const __m256i*>(&t.psqts[removed[index] * PSQT_BUCKETS + base]);
+            for (std::uint32_t k = 0; k < NUM_PSQT_REGS; ++k)
+                psqtRegs[k] = _mm256_sub_epi32(psqtRegs[k], _mm256_load_si256(&column[k]));
+        }
+
+        for (std::uint32_t index = 0; index < ca; ++index) {
+            auto column = reinterpret_cast<const __m256i*>(&t.psqts[added[index] * PSQT_BUCKETS + base]);
+            for (std::uint32_t k = 0; k < NUM_PSQT_REGS; ++k)
+                psqtRegs[k] = _mm256_add_epi32(psqtRegs[k], _mm256_load_si256(&column[k]));
+        }
+
+        for (std::uint32_t k = 0; k < NUM_PSQT_REGS; ++k) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&toPsqt[base]) + k, psqtRegs[k]);
+            if (copyPsqt)
+                _mm256_store_si256(reinterpret_cast<__m256i*>(&copyPsqt[base]) + k, psqtRegs[k]);
+        }
+    }
+#else
+    for (std::uint32_t j = 0; j < Transformer::HalfDimensions; ++j) {
+        std::int16_t v = from[j];
+
+        for (std::uint32_t index = 0; index < cr; ++index)
+            v -= t.weights[Transformer::HalfDimensions * removed[index] + j];
+
+        for (std::uint32_t index = 0; index < ca; ++index)
+            v += t.weights[Transformer::HalfDimensions * added[index] + j];
+
+        to[j] = v;
+        if (copy)
+            copy[j] = v;
+    }
+
+    for (std::size_t k = 0; k < PSQT_BUCKETS; ++k) {
+        std::int32_t v = fromPsqt[k];
+
+        for (std::uint32_t index = 0; index < cr; ++index)
+            v -= t.psqts[removed[index] * PSQT_BUCKETS + k];
+
+        for (std::uint32_t index = 0; index < ca; ++index)
+            v += t.psqts[added[index] * PSQT_BUCKETS + k];
+
+        toPsqt[k] = v;
+        if (copyPsqt)
+            copyPsqt[k] = v;
+    }
+#endif
+}
+
+template <std::int32_t WeightScaleBits, std::int32_t InputDimensions> class ClippedReLU {
+
+public:
+    inline static std::uint8_t * propagate(std::int32_t * features, char * outBuffer);
+    inline static std::uint8_t * propagateSqrt(std::int32_t* features, char* outBuffer);
+};
+
+template <std::int32_t WeightScaleBits, std::int32_t InputDimensions>
+inline std::uint8_t* ClippedReLU<WeightScaleBits, InputDimensions>::propagate(std::int32_t* features, char* outBuffer) {
+
+    auto output = reinterpret_cast<uint8_t*>(outBuffer);
+
+#if defined(USE_AVX2)
+    auto chunks = InputDimensions / SIMD_WIDTH;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i offsets = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
+    const auto in = reinterpret_cast<const __m256i*>(features);
+    const auto out = reinterpret_cast<__m256i*>(output);
+
+    for (auto i = 0; i < chunks; ++i) {
+        const __m256i words0 = _mm256_srai_epi16(_mm256_packs_epi32(_mm256_loadA_si256(&in[i * 4 + 0]), _mm256_loadA_si256(&in[i * 4 + 1])), WeightScaleBits);
+        const __m256i words1 = _mm256_srai_epi16(_mm256_packs_epi32(_mm256_loadA_si256(&in[i * 4 + 2]), _mm256_loadA_si256(&in[i * 4 + 3])), WeightScaleBits);
+        _mm256_storeA_si256(&out[i], _mm256_permutevar8x32_epi32(_mm256_max_epi8(_mm256_packs_epi16(words0, words1), zero), offsets));
+    }
+#endif
+
+    std::uint32_t start = chunks * SIMD_WIDTH;
+
+    for (std::uint32_t i = start; i < InputDimensions; ++i)
+        output[i] = static_cast<std::uint8_t>(std::max(0, std::min(127, features[i] >> WeightScaleBits)));
+
+    return output;
+}
+
+template <std::int32_t WeightScaleBits, std::int32_t InputDimensions>
+inline std::uint8_t* ClippedReLU<WeightScaleBits, InputDimensions>::propagateSqrt(std::int32_t* features, char* outBuffer)
+{
+    auto output = reinterpret_cast<uint8_t*>(outBuffer);
+
+#if defined(USE_AVX2)
+    if constexpr (InputDimensions == 16) {
+        const auto in_vec = reinterpret_cast<const __m256i*>(features);
+        __m256i v0 = _mm256_load_si256(&in_vec[0]);   // features[0..7]
+        __m256i v1 = _mm256_load_si256(&in_vec[1]);   // features[8..15]
+
+        // Clamp to [-46340, 46340]: 46340^2 = 2,147,388,400 < INT32_MAX, no overflow in mullo_epi32
+        const __m256i clamp_lo = _mm256_set1_epi32(-46340);
+        const __m256i clamp_hi = _mm256_set1_epi32(46340);
+        v0 = _mm256_min_epi32(_mm256_max_epi32(v0, clamp_lo), clamp_hi);
+        v1 = _mm256_min_epi32(_mm256_max_epi32(v1, clamp_lo), clamp_hi);
+
+        // Square (no int32 overflow after clamp)
+        v0 = _mm256_mullo_epi32(v0, v0);
+        v1 = _mm256_mullo_epi32(v1, v1);
+
+        // Shift right by 2*WeightScaleBits+7: equivalent to >>WeightScaleBits*2 then /128
+        v0 = _mm256_srli_epi32(v0, 2 * WeightScaleBits + 7);
+        v1 = _mm256_srli_epi32(v1, 2 * WeightScaleBits + 7);
+
+        // Clamp to [0, 127]: values are non-negative (squares), only upper bound needed
+        const __m256i out_max = _mm256_set1_epi32(127);
+        v0 = _mm256_min_epi32(v0, out_max);
+        v1 = _mm256_min_epi32(v1, out_max);
+
+        // Pack int32->int16->uint8, fixing AVX2 lane interleaving with a permute
+        __m256i packed16 = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(v0, v1), 0b11011000);   // reorders to [v0[0..7], v1[0..7]]
+
+        __m256i packed8 = _mm256_packus_epi16(packed16, _mm256_setzero_si256());
+        // Layout: [v0[0..7] | zeros | v1[0..7] | zeros]; combine the two halves:
+        __m128i combined = _mm_unpacklo_epi64(
+            _mm256_castsi256_si128(packed8),
+            _mm256_extracti128_si256(packed8, 1));      // [v0[0..7], v1[0..7]] = 16 bytes
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outBuffer), combined);
+        return output;
+    }
+#endif
+
+    for (std::uint32_t i = 0; i < InputDimensions; ++i)
+        output[i] = static_cast<std::uint8_t>(std::max(0ll, std::min(127ll, (((long long)features[i] * features[i]) >> (2 * WeightScaleBits)) / 128)));
+
+    return output;
+}
+
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
+static inline std::int32_t * propagate(const Layer<OutputDimensions, InputDimensions> & layer, std::uint8_t * features, char * outBuffer) {
+
+    const auto & biases  = layer.biases;
+    const auto & weights = layer.weights;
+
+    auto output = reinterpret_cast<std::int32_t*>(outBuffer);
+
+#if defined(USE_AVX512)
+    if constexpr (InputDimensions % (SIMD_WIDTH * 2) == 0) {
+        const std::uint32_t chunks = InputDimensions / (SIMD_WIDTH * 2);
+        const auto input_vector = reinterpret_cast<const __m512i*>(features);
+
+        if constexpr (OutputDimensions % 4 == 0 && InputDimensions >= 128) {
+            for (std::uint32_t i = 0; i < OutputDimensions; i += 4) {
+                __m512i s0 = _mm512_setzero_si512();
+                __m512i s1 = _mm512_setzero_si512();
+                __m512i s2 = _mm512_setzero_si512();
+                __m512i s3 = _mm512_setzero_si512();
+                const auto r0 = reinterpret_cast<const __m512i*>(&weights[(i+0) * InputDimensions]);
+                const auto r1 = reinterpret_cast<const __m512i*>(&weights[(i+1) * InputDimensions]);
+                const auto r2 = reinterpret_cast<const __m512i*>(&weights[(i+2) * InputDimensions]);
+                const auto r3 = reinterpret_cast<const __m512i*>(&weights[(i+3) * InputDimensions]);
+                for (std::uint32_t j = 0; j < chunks; ++j) {
+                    const __m512i inp = _mm512_loadu_si512(&input_vector[j]);
+                    s0 = affine_acc_512(s0, inp, _mm512_loadu_si512(&r0[j]));
+                    s1 = affine_acc_512(s1, inp, _mm512_loadu_si512(&r1[j]));
+                    s2 = affine_acc_512(s2, inp, _mm512_loadu_si512(&r2[j]));
+                    s3 = affine_acc_512(s3, inp, _mm512_loadu_si512(&r3[j]));
+                }
+                const __m128i bias = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&biases[i]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), m512_haddx4(s0, s1, s2, s3, bias));
+            }
+            return output;
+        }
+
+        for (std::uint32_t i = 0; i < OutputDimensions; ++i) {
+            __m512i sum = _mm512_setzero_si512();
+            const auto row = reinterpret_cast<const __m512i*>(&weights[i * InputDimensions]);
+            for (std::uint32_t j = 0; j < chunks; ++j)
+                sum = affine_acc_512(sum, _mm512_loadu_si512(&input_vector[j]), _mm512_loadu_si512(&row[j]));
+            output[i] = _mm512_reduce_add_epi32(sum) + biases[i];
+        }
+        return output;
+    }
+#endif
+
+#if defined(USE_AVX2)
+    std::uint32_t chunks = InputDimensions / SIMD_WIDTH;
+    const auto input_vector = reinterpret_cast<const __m256i*>(features);
+#endif
+
+#if defined(USE_AVX2)
+    // 4-way kernel blocking: process 4 output neurons simultaneously.
+    // 4 independent accumulator chains allow better ILP vs. one serial chain per output.
+    // Threshold is one full SIMD chunk so the small 32x32 hidden layer also takes this path,
+    // where batching the four reductions is a bigger win than the dot-product itself.
+    if constexpr (OutputDimensions % 4 == 0 && InputDimensions >= 32) {
+        for (std::uint32_t i = 0; i < OutputDimensions; i += 4) {
+            __m256i s0 = _mm256_setzero_si256();
+            __m256i s1 = _mm256_setzero_si256();
+            __m256i s2 = _mm256_setzero_si256();
+            __m256i s3 = _mm256_setzero_si256();
+            const auto r0 = reinterpret_cast<const __m256i*>(&weights[(i+0) * InputDimensions]);
+            const auto r1 = reinterpret_cast<const __m256i*>(&weights[(i+1) * InputDimensions]);
+            const auto r2 = reinterpret_cast<const __m256i*>(&weights[(i+2) * InputDimensions]);
+            const auto r3 = reinterpret_cast<const __m256i*>(&weights[(i+3) * InputDimensions]);
+            for (std::uint32_t j = 0; j < chunks; ++j) {
+                const __m256i inp = _mm256_loadA_si256(&input_vector[j]);
+                s0 = affine_acc_256(s0, inp, _mm256_load_si256(&r0[j]));
+                s1 = affine_acc_256(s1, inp, _mm256_load_si256(&r1[j]));
+                s2 = affine_acc_256(s2, inp, _mm256_load_si256(&r2[j]));
+                s3 = affine_acc_256(s3, inp, _mm256_load_si256(&r3[j]));
+            }
+            const __m128i bias = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&biases[i]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), m256_haddx4(s0, s1, s2, s3, bias));
+        }
+        return output;
+    }
+#endif
+
+    for (std::uint32_t i = 0; i < OutputDimensions; ++i) {
+        const std::uint32_t offset = i * InputDimensions;
+
+#if defined(USE_AVX2)
+        __m256i sum = _mm256_setzero_si256();
+        const auto row = reinterpret_cast<const __m256i*>(&weights[offset]);
+        for (std::uint32_t j = 0; j < chunks; ++j) {
+            sum = affine_acc_256(sum, _mm256_loadA_si256(&input_vector[j]), _mm256_load_si256(&row[j]));
+        }
+        __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_BADC));
+        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_CDAB));
+        output[i] = _mm_cvtsi128_si32(sum128) + biases[i];
+#endif
+    }
+
+    return output;
+}
+
+//
+//  positions of the set bits of every byte, used to turn a compare mask into chunk indexes
+//
+
+struct NnzTable {
+    alignas(16) std::uint16_t offsets[256][8];
+
+    constexpr NnzTable() : offsets{} {
+        for (int mask = 0; mask < 256; ++mask) {
+            int k = 0;
+            for (int bit = 0; bit < 8; ++bit) {
+                if (mask & (1 << bit))
+                    offsets[mask][k++] = static_cast<std::uint16_t>(bit);
+            }
+        }
+    }
+};
+
+static constexpr NnzTable s_nnzTable;
+
+//
+//  writes the indexes of the non-zero 4-byte chunks of the input, returns how many there are
+//
+
+template <std::int32_t NumChunks>
+static inline std::int32_t findNnz(const std::int32_t * input, std::uint16_t * out) {
+
+    std::int32_t count = 0;
+
+#if defined(USE_AVX2)
+    static_assert(NumChunks % 8 == 0);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i increment = _mm_set1_epi16(8);
+    __m128i base = _mm_setzero_si128();
+
+    for (std::int32_t i = 0; i < NumChunks; i += 8) {
+        const __m256i chunks = _mm256_loadA_si256(reinterpret_cast<const __m256i*>(input + i));
+        const unsigned mask = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(chunks, zero)))) & 0xFF;
+        const __m128i offsets = _mm_load_si128(reinterpret_cast<const __m128i*>(s_nnzTable.offsets[mask]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + count), _mm_add_epi16(base, offsets));
+        count += _mm_popcnt_u32(mask);
+        base = _mm_add_epi16(base, increment);
+    }
+#else
+    for (std::int32_t i = 0; i < NumChunks; ++i) {
+        if (input[i])
+            out[count++] = static_cast<std::uint16_t>(i);
+    }
+#endif
+
+    return count;
+}
+
+template <std::int32_t OutputDimensions, std::int32_t InputDimensions>
+static inline std::int32_t * propagate(const SparseLayer<OutputDimensions, InputDimensions> & layer, std::uint8_t * features, char * outBuffer) {
+
+    constexpr auto ChunkSize = SparseLayer<OutputDimensions, InputDimensions>::ChunkSize;
+    constexpr auto NumChunks = SparseLayer<OutputDimensions, InputDimensions>::NumChunks;
+
+    const auto & biases  = layer.biases;
+    const auto & weights = layer.weights;
+
+    auto output = reinterpret_cast<std::int32_t*>(outBuffer);
+    const auto input = reinterpret_cast<const std::int32_t*>(features);
+
+    alignas(CACHE_LINE) std::uint16_t nnz[NumChunks];
+    const std::int32_t count = findNnz<NumChunks>(input, nnz);
+
+#if defined(USE_AVX512)
+    if constexpr (OutputDimensions == 16) {
+        // two accumulators take alternate chunks so the multiply-adds do not wait on each other
+        __m512i s0 = _mm512_setzero_si512();
+        __m512i s1 = _mm512_setzero_si512();
+        std::int32_t k = 0;
+
+        for (; k + 1 < count; k += 2) {
+            const auto j0 = nnz[k + 0];
+            const auto j1 = nnz[k + 1];
+            s0 = affine_acc_512(s0, _mm512_set1_epi32(input[j0]), _mm512_load_si512(&weights[j0 * OutputDimensions * ChunkSize]));
+            s1 = affine_acc_512(s1, _mm512_set1_epi32(input[j1]), _mm512_load_si512(&weights[j1 * OutputDimensions * ChunkSize]));
+        }
+
+        if (k < count) {
+            const auto j = nnz[k];
+            s0 = affine_acc_512(s0, _mm512_set1_epi32(input[j]), _mm512_load_si512(&weights[j * OutputDimensions * ChunkSize]));
+        }
+
+        const __m512i sum = _mm512_add_epi32(_mm512_add_epi32(s0, s1), _mm512_load_si512(biases));
+        _mm512_store_si512(output, sum);
+        return output;
+    }
+#endif
+
+#if defined(USE_AVX2)
+    if constexpr (OutputDimensions % 8 == 0) {
+        constexpr std::int32_t NumRegs = OutputDimensions / 8;
+        __m256i acc[NumRegs];
+
+        for (std::int32_t r = 0; r < NumRegs; ++r)
+            acc[r] = _mm256_load_si256(reinterpret_cast<const __m256i*>(&biases[r * 8]));
+
+        for (std::int32_t k = 0; k < count; ++k) {
+            const auto j = nnz[k];
+            const __m256i in = _mm256_set1_epi32(input[j]);
+            const auto column = reinterpret_cast<const __m256i*>(&weights[j * OutputDimensions * ChunkSize]);
+
+            for (std::int32_t r = 0; r < NumRegs; ++r)
+                acc[r] = affine_acc_256(acc[r], in, _mm256_load_si256(&column[r]));
+        }
+
+        for (std::int32_t r = 0; r < NumRegs; ++r)
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&output[r * 8]), acc[r]);
+
+        return output;
+    }
+#endif
+
+    for (std::int32_t i = 0; i < OutputDimensions; ++i)
+        output[i] = biases[i];
+
+    for (std::int32_t k = 0; k < count; ++k) {
+        const auto j = nnz[k];
+        const auto column = &weights[j * OutputDimensions * ChunkSize];
+
+        for (std::int32_t i = 0; i < OutputDimensions; ++i) {
+            for (std::int32_t b = 0; b < ChunkSize; ++b)
+                output[i] += features[j * ChunkSize + b] * column[i * ChunkSize + b];
+        }
+    }
+
+    return output;
+}
+
+static std::int32_t * propagateNetwork(const LayeredNetwork & network, std::uint8_t * features, char * outBuffer) {
+    auto ret = propagate(network.inputLayer, features, outBuffer + 320);        // forward propagation
+    auto fc_0_out = ret[15];
+    char ac_sqr_0_out[32] = { 0 };
+    ClippedReLU<6, 16>::propagateSqrt(ret, ac_sqr_0_out);                       // clip
+    char ac_out[32];
+    auto clipped = ClippedReLU<6, 16>::propagate(ret, ac_out);
+    std::memcpy(ac_sqr_0_out + 15, ac_out, 15);
+    ret = propagate(network.hiddenLayer1, (std::uint8_t*)ac_sqr_0_out, outBuffer + 128); // forward propagation
+    clipped = ClippedReLU<6, 32>::propagate(ret, outBuffer + 64);               // clip
+    ret = propagate(network.hiddenLayer2, clipped, outBuffer);                   // forward propagation
+
+    std::int32_t fwdOut = int(fc_0_out) * (600 * 16) / (127 * (1 << 6));
+    std::int32_t outputValue = ret[0] + fwdOut;
+    ret[0] = outputValue;
+
+    return ret;
+}
+
+} // namespace NNUE_SIMD
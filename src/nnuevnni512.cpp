@@ -0,0 +1,45 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2023 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+//  AVX-512 VNNI kernels of a dispatching build, see nnuesimd.h
+//
+
+#if defined(USE_DISPATCH) && !defined(PURE_HCE)
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f,avx512bw,avx512vnni"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512f,avx512bw,avx512vnni")
+#endif
+
+#define USE_AVX512 1
+#define USE_VNNI   1
+
+#include "nnue.h"
+
+#define NNUE_SIMD Vnni512
+#include "nnuesimd.h"
+
+extern const NnueKernels NnueKernelsVnni512 = { &Vnni512::updateAccumulator, &Vnni512::transformFeatures, &Vnni512::propagateNetwork };
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,186 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "numa.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//
+//  from linux/mempolicy.h, which is not always installed
+//
+
+static constexpr int MPOL_INTERLEAVE_ = 3;
+static constexpr unsigned MPOL_MF_MOVE_ = 1 << 1;
+
+//
+//  parses a sysfs list such as "0-63,128-191"
+//
+
+static std::vector<int> parseList(const std::string & path)
+{
+    std::vector<int> items;
+    std::ifstream file(path);
+    std::string list;
+
+    if (!file || !std::getline(file, list))
+        return items;
+
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        auto dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+
+        for (int i = first; i <= last; ++i)
+            items.push_back(i);
+    }
+
+    return items;
+}
+
+static std::vector<int> onlineNodes()
+{
+    return parseList("/sys/devices/system/node/online");
+}
+#endif
+
+int Numa::nodes()
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    auto online = onlineNodes();
+    return online.empty() ? 1 : static_cast<int>(online.size());
+#else
+    return 1;
+#endif
+}
+
+//
+//  must be called before the memory is touched, pages already present stay where they are
+//  unless the kernel is able to migrate them
+//
+
+bool Numa::interleave(void * addr, size_t size)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    auto online = onlineNodes();
+
+    if (online.size() < 2)
+        return false;
+
+    unsigned long mask[16] = {};
+    const unsigned long bits = 8 * sizeof(unsigned long);
+
+    for (auto node : online) {
+        if (node < static_cast<int>(bits * 16))
+            mask[node / bits] |= 1ul << (node % bits);
+    }
+
+    return syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE_, mask, bits * 16, MPOL_MF_MOVE_) == 0;
+#else
+    return false;
+#endif
+}
+
+bool Numa::bindThread(int node)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    auto cpus = parseList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+    if (cpus.empty())
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+
+    return syscall(SYS_sched_setaffinity, 0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+//
+//  samples up to 4096 pages of the range and returns the share of every node, e.g.
+//  "node0 50% node1 50%", or an empty string if the kernel cannot tell
+//
+
+std::string Numa::placement(const void * addr, size_t size)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pages = size / pageSize;
+    const size_t samples = std::min(pages, static_cast<size_t>(4096));
+
+    if (!samples)
+        return std::string();
+
+    std::vector<void*> sampled(samples);
+    std::vector<int> status(samples, -1);
+
+    for (size_t i = 0; i < samples; ++i)
+        sampled[i] = const_cast<char*>(static_cast<const char*>(addr)) + (i * (pages / samples)) * pageSize;
+
+    if (syscall(SYS_move_pages, 0, samples, sampled.data(), nullptr, status.data(), 0) != 0)
+        return std::string();
+
+    std::vector<size_t> perNode;
+    size_t present = 0;
+
+    for (auto node : status) {
+        if (node < 0)
+            continue; // not faulted in yet
+
+        if (static_cast<size_t>(node) >= perNode.size())
+            perNode.resize(node + 1, 0);
+
+        ++perNode[node];
+        ++present;
+    }
+
+    if (!present)
+        return std::string();
+
+    std::ostringstream ss;
+
+    for (size_t node = 0; node < perNode.size(); ++node) {
+        if (perNode[node])
+            ss << (ss.tellp() ? " " : "") << "node" << node << " " << (100 * perNode[node] + present / 2) / present << "%";
+    }
+
+    return ss.str();
+#else
+    (void)addr;
+    (void)size;
+    return std::string();
+#endif
+}
@@ -0,0 +1,47 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "types.h"
+
+//
+//  Placement of large allocations on NUMA hosts, through raw syscalls so there is no
+//  dependency on libnuma. On single node hosts and outside of Linux every call is a no-op.
+//
+
+class Numa
+{
+public:
+    enum class Policy
+    {
+        None,       // pages land wherever the kernel puts them
+        Interleave, // pages are spread round robin over all nodes when first touched
+        FirstTouch  // the table is cleared by threads pinned to each node in turn
+    };
+
+public:
+    static int nodes();
+    static bool interleave(void * addr, size_t size);
+    static bool bindThread(int node);
+    static std::string placement(const void * addr, size_t size);
+};
+
+#endif // NUMA_H
@@ -0,0 +1,168 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perft.h"
+#include "notation.h"
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+static std::string mnps(NODES nodes, double seconds)
+{
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << (seconds > 0 ? nodes / seconds / 1e6 : 0.0);
+    return ss.str();
+}
+
+Perft::Perft(unsigned int threads, size_t hashMb) :
+    m_threads(threads ? threads : 1),
+    m_hashMask(0)
+{
+    if (!hashMb)
+        return;
+
+    size_t entries = 1;
+    while (entries * 2 * sizeof(PerftEntry) <= hashMb * 1024 * 1024)
+        entries *= 2;
+
+    m_hash.resize(entries);
+    m_hashMask = entries - 1;
+}
+
+bool Perft::probe(U64 hash, int depth, NODES & nodes) const
+{
+    if (m_hash.empty())
+        return false;
+
+    const auto & entry = m_hash[hash & m_hashMask];
+    U64 data = entry.m_data;
+
+    if ((entry.m_key ^ data) != hash || static_cast<int>(data & 0xff) != depth)
+        return false;
+
+    nodes = static_cast<NODES>(data >> 8);
+    return true;
+}
+
+void Perft::store(U64 hash, int depth, NODES nodes)
+{
+    if (m_hash.empty())
+        return;
+
+    auto & entry = m_hash[hash & m_hashMask];
+    U64 data = (static_cast<U64>(nodes) << 8) | static_cast<U64>(depth);
+
+    entry.m_key  = hash ^ data;
+    entry.m_data = data;
+}
+
+NODES Perft::count(Position & pos, int depth)
+{
+    MoveList mvlist;
+    GenLegalMoves(pos, mvlist);
+
+    //
+    //  bulk counting: every legal move at the last ply is a leaf
+    //
+
+    if (depth == 1)
+        return static_cast<NODES>(mvlist.Size());
+
+    NODES nodes = 0;
+    U64 hash = pos.Hash();
+
+    if (probe(hash, depth, nodes))
+        return nodes;
+
+    auto mvSize = mvlist.Size();
+    for (size_t i = 0; i < mvSize; ++i) {
+        pos.MakeMove(mvlist[i].m_mv);
+        nodes += count(pos, depth - 1);
+        pos.UnmakeMove();
+    }
+
+    store(hash, depth, nodes);
+    return nodes;
+}
+
+NODES Perft::run(const Position & pos, int depth)
+{
+    assert(depth >= 1);
+
+    MoveList root;
+    GenLegalMoves(pos, root);
+
+    auto rootSize = root.Size();
+    std::vector<NODES> nodes(rootSize, 0);
+    std::vector<double> elapsed(rootSize, 0.0);
+    std::atomic<size_t> next(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    //
+    //  every thread works on its own copy of the position and takes root moves one by one
+    //
+
+    auto worker = [&]() {
+        std::unique_ptr<Position> local(new Position);
+        local->SetFEN(pos.FEN());
+
+        size_t i;
+        while ((i = next++) < rootSize) {
+            auto t0 = std::chrono::steady_clock::now();
+
+            local->MakeMove(root[i].m_mv);
+            nodes[i] = depth > 1 ? count(*local, depth - 1) : 1;
+            local->UnmakeMove();
+
+            elapsed[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < m_threads; ++t)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto & t : threads)
+        t.join();
+
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    NODES sumNodes = 0;
+
+    for (size_t i = 0; i < rootSize; ++i) {
+        sumNodes += nodes[i];
+        std::cout << MoveToStrLong(root[i].m_mv) << ": " << nodes[i]
+            << " time " << static_cast<int>(elapsed[i] * 1000)
+            << " mnps " << mnps(nodes[i], elapsed[i]) << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "Time  : " << static_cast<int>(total * 1000) << std::endl;
+    std::cout << "Nodes : " << sumNodes << std::endl;
+    std::cout << "Mnps  : " << mnps(sumNodes, total) << std::endl;
+
+    return sumNodes;
+}
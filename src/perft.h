@@ -0,0 +1,60 @@
+/*
+*  Igel - a UCI chess playing engine derived from GreKo 2018.01
+*
+*  Copyright (C) 2019-2025 Volodymyr Shcherbyna <volodymyr@shcherbyna.com>
+*
+*  Igel is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  Igel is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with Igel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERFT_H
+#define PERFT_H
+
+#include "moves.h"
+
+#include <vector>
+
+//
+//  Move generator benchmark: counts leaf nodes of the legal move tree, with bulk counting
+//  at the last ply, an optional hash table shared by all threads and root moves split
+//  across threads. Prints a divide line (nodes, time, Mnps) for every root move.
+//
+
+class Perft
+{
+    struct PerftEntry
+    {
+        U64 m_key;  // hash ^ m_data, so a torn write from another thread never matches
+        U64 m_data; // nodes << 8 | depth
+    };
+
+public:
+    Perft(unsigned int threads, size_t hashMb);
+    Perft(const Perft&) = delete;
+    Perft& operator=(const Perft&) = delete;
+
+public:
+    NODES run(const Position & pos, int depth);
+
+private:
+    NODES count(Position & pos, int depth);
+    bool probe(U64 hash, int depth, NODES & nodes) const;
+    void store(U64 hash, int depth, NODES nodes);
+
+private:
+    unsigned int m_threads;
+    std::vector<PerftEntry> m_hash;
+    U64 m_hashMask;
+};
+
+#endif // PERFT_H
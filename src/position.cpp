@@ -95,7 +95,11 @@ void Position::Clear()
 #endif
 
     m_undos[0].reset();
-    m_state = &m_undos[0];
+
+#if !defined(PURE_HCE)
+    m_states[0].reset();
+    m_state = &m_states[0];
+#endif
 
     for (FLD f = 0; f < 64; ++f)
         m_board[f] = NOPIECE;
@@ -252,6 +256,164 @@ bool Position::IsAttacked(FLD f, COLOR side) const
     return false;
 }
 
+//
+//  Checks that a move taken from outside of the generator (hash move, killers, counter move)
+//  could have been produced by GenAllMoves in this position. Own king safety is checked
+//  separately by isLegal.
+//
+
+bool Position::isPseudoLegal(Move mv) const
+{
+    if (!mv)
+        return false;
+
+    FLD from = mv.From();
+    FLD to = mv.To();
+    PIECE piece = mv.Piece();
+    PIECE captured = mv.Captured();
+    PIECE promotion = mv.Promotion();
+
+    COLOR side = m_side;
+    COLOR opp = side ^ 1;
+
+    if (piece < PW || piece > KB || GetColor(piece) != side || m_board[from] != piece)
+        return false;
+
+    if (mv.IsCastling() || (piece == (KING | side) && (mv == MOVE_O_O[side] || mv == MOVE_O_O_O[side]))) {
+        for (U8 flank : { KINGSIDE, QUEENSIDE }) {
+            if (!CanCastle(side, flank))
+                continue;
+
+            Move castling;
+
+            if (g_uci_chess960)
+                castling = Move::Castling(m_Kings[side], m_castlingRookSq[side][flank], KING | side);
+            else
+                castling = flank == KINGSIDE ? MOVE_O_O[side] : MOVE_O_O_O[side];
+
+            if (mv == castling)
+                return true;
+        }
+
+        return false;
+    }
+
+    auto enPassant = GetPieceType(piece) == PAWN && to == m_ep && m_ep != NF;
+
+    if (captured) {
+        if (captured < PW || captured > QB || GetColor(captured) != opp)
+            return false;
+
+        if (enPassant) {
+            if (captured != (PAWN | opp) || m_board[to])
+                return false;
+        }
+        else if (m_board[to] != captured)
+            return false;
+    }
+    else if (m_board[to])
+        return false;
+
+    if (GetPieceType(piece) == PAWN) {
+        int fwd = -8 + 16 * side;
+        int second = 6 - 5 * side;
+        int seventh = 1 + 5 * side;
+
+        if ((Row(from) == seventh) != (promotion != NOPIECE))
+            return false;
+
+        if (promotion && (GetColor(promotion) != side || promotion < NW || promotion > QB))
+            return false;
+
+        if (captured)
+            return (BB_PAWN_ATTACKS[from][side] & BB_SINGLE[to]) != 0;
+
+        if (to == from + fwd)
+            return true;
+
+        return Row(from) == second && to == from + 2 * fwd && !m_board[from + fwd];
+    }
+
+    if (promotion)
+        return false;
+
+    U64 occ = BitsAll();
+    U64 att = 0;
+
+    switch (GetPieceType(piece))
+    {
+        case KNIGHT: att = BB_KNIGHT_ATTACKS[from];     break;
+        case BISHOP: att = BishopAttacks(from, occ);    break;
+        case ROOK:   att = RookAttacks(from, occ);      break;
+        case QUEEN:  att = QueenAttacks(from, occ);     break;
+        case KING:   att = BB_KING_ATTACKS[from];       break;
+        default:     break;
+    }
+
+    return (att & BB_SINGLE[to]) != 0;
+}
+
+//
+//  Exact legality of a pseudo-legal move without making it: rebuild the occupancy the
+//  move leaves behind and look for enemy attacks on the king. Covers king moves, pins,
+//  evasions, en passant discoveries and the final square of a castling.
+//
+
+bool Position::isLegal(Move mv) const
+{
+    FLD from = mv.From();
+    FLD to = mv.To();
+    PIECE piece = mv.Piece();
+
+    COLOR side = m_side;
+    COLOR opp = side ^ 1;
+
+    U64 occ = BitsAll();
+    U64 removed = 0;
+    FLD K = m_Kings[side];
+
+    if (mv.IsCastling() || (piece == (KING | side) && (mv == MOVE_O_O[side] || mv == MOVE_O_O_O[side]))) {
+        FLD rfrom;
+        U8 flank;
+
+        if (mv == MOVE_O_O[side]) {
+            flank = KINGSIDE;
+            rfrom = HX[side];
+        }
+        else if (mv == MOVE_O_O_O[side]) {
+            flank = QUEENSIDE;
+            rfrom = AX[side];
+        }
+        else {
+            rfrom = to; // FRC: to == rook-from
+            flank = (Col(rfrom) > Col(from)) ? KINGSIDE : QUEENSIDE;
+        }
+
+        int rankBase = (side == WHITE) ? A1 : A8;
+        FLD kto = (flank == KINGSIDE) ? (FLD)(rankBase + 6) : (FLD)(rankBase + 2);
+        FLD rto = (flank == KINGSIDE) ? (FLD)(rankBase + 5) : (FLD)(rankBase + 3);
+
+        occ ^= BB_SINGLE[from] | BB_SINGLE[rfrom];
+        occ |= BB_SINGLE[kto] | BB_SINGLE[rto];
+        K = kto;
+    }
+    else {
+        if (mv.Captured()) {
+            FLD capture = (GetPieceType(piece) == PAWN && to == m_ep) ? to + 8 - 16 * side : to;
+            removed = BB_SINGLE[capture];
+            occ ^= removed;
+        }
+
+        occ ^= BB_SINGLE[from];
+        occ |= BB_SINGLE[to];
+
+        if (piece == (KING | side))
+            K = to;
+    }
+
+    return (GetAttacks(K, opp, occ) & ~removed) == 0;
+}
+
 #if !defined(PURE_HCE)
 inline PieceId Position::piece_id_on(Square sq) const
 {
@@ -274,10 +436,11 @@ bool Position::MakeMove(Move mv)
     undo.m_hash = Hash();
     undo.m_mv = mv;
 
-    undo.previous = m_undoSize == 1 ? nullptr : m_state;
-    m_state = &undo;
-
 #if !defined(PURE_HCE)
+    auto & state = m_states[m_undoSize % MAX_STATES];
+    state.previous = m_state;
+    m_state = &state;
+
     m_state->accumulator.computed_accumulation = false;
     m_state->accumulator.computed_score = false;
     PieceId dp0 = PIECE_ID_NONE;
@@ -538,9 +701,9 @@ void Position::UnmakeMove()
     --m_ply;
     m_side ^= 1;
 
-    m_state = undo.previous;
-    if (!m_state)
-        m_state = &m_undos[0];
+#if !defined(PURE_HCE)
+    m_state = m_state->previous;
+#endif
 }
 
 void Position::MakeNullMove()
@@ -552,9 +715,11 @@ void Position::MakeNullMove()
     undo.m_hash = Hash();
     undo.m_mv = 0;
 
-    undo.previous = m_undoSize == 1 ? nullptr : m_state;
-    m_state = &undo;
 #if !defined(PURE_HCE)
+    auto & state = m_states[m_undoSize % MAX_STATES];
+    state.previous = m_state;
+    m_state = &state;
+
     m_state->accumulator.computed_score = false;
     m_state->accumulator.computed_accumulation = false;
     m_state->dirtyPiece.dirty_num = 0;
@@ -580,10 +745,9 @@ void Position::UnmakeNullMove()
     --m_ply;
     m_side ^= 1;
 
-    m_state = undo.previous;
-
-    if (!m_state)
-        m_state = &m_undos[0];
+#if !defined(PURE_HCE)
+    m_state = m_state->previous;
+#endif
 }
 
 void Position::MovePiece(PIECE p, FLD from, FLD to)
@@ -981,21 +1145,13 @@ EVAL Position::nonPawnMaterial(COLOR side)
 
 Move Position::getRandomMove()
 {
-    MoveList pseudo;
-    GenAllMoves(*this, pseudo);
-    std::vector<Move> moves;
-
-    for (size_t i = 0; i < pseudo.Size(); ++i) {
-        if (MakeMove(pseudo[i].m_mv)) {
-            moves.push_back(pseudo[i].m_mv);
-            UnmakeMove();
-        }
-    }
+    MoveList moves;
+    GenLegalMoves(*this, moves);
 
-    if (moves.empty())
+    if (!moves.Size())
         return 0;
     else
-        return moves[Rand32() % moves.size()];
+        return moves[Rand32() % moves.Size()].m_mv;
 }
 
 #if !defined(PURE_HCE)
@@ -1029,13 +1185,17 @@ std::uint32_t Position::getActiveIndexes(COLOR c, std::uint32_t indexes[]) {
     return count;
 }
 
-std::pair<std::uint32_t, std::uint32_t> Position::getChangedIndexes(COLOR c, std::uint32_t added[], std::uint32_t removed[]) {
+//
+//  features changed by dp, the move into this position or into an ancestor reached without a
+//  move of the own king, so both are seen from the current king square
+//
+
+std::pair<std::uint32_t, std::uint32_t> Position::getChangedIndexes(COLOR c, const DirtyPiece & dp, std::uint32_t added[], std::uint32_t removed[]) {
     const PieceId target = static_cast<PieceId>(PIECE_ID_KING + c);
     auto pieces = c == WHITE ? evalList.piece_list_fw() : evalList.piece_list_fb();
     Square kingSq = static_cast<Square>((pieces[target] - PS_KING) % SQUARE_NB);
 
     kingSq = FLIP[c][kingSq];
-    const auto & dp = state()->dirtyPiece;
 
     // Precompute once per call: orient(kingSq, kingSq, c) = kingSq ^ flip_mask
     const int flip_mask = (bool(c) * SQ_A8) ^ ((Col(kingSq) < FILE_E) * SQ_H1);
@@ -1072,4 +1232,4 @@ inline std::uint32_t Position::makeIndex(Square sq_k, Square sq, Piece p, COLOR
     Square o_ksq = orient(sq_k, sq_k, c);
     return static_cast<std::uint32_t>(orient(sq_k, sq, c) + PieceSquareIndex[c][p] + PS_END * KingBuckets[o_ksq]);
 }
-#endif
\ No newline at end of file
+#endif
@@ -89,32 +89,20 @@ struct alignas(CACHE_LINE) Accumulator {
     bool computed_accumulation;
     bool computed_score;
 };
-#endif
 
-struct Undo
-{
-    U8   m_castlings;
-    FLD  m_ep;
-    int  m_fifty;
-    U64  m_hash;
-    Move m_mv;
+//
+//  NNUE state of a position: its accumulator and the pieces changed by the move into it,
+//  linked to the state that move was made from
+//
 
-#if !defined(PURE_HCE)
+struct NnueState
+{
     Accumulator accumulator;
     DirtyPiece dirtyPiece;
-#endif
-    Undo* previous;
+    NnueState* previous;
 
     void reset()
     {
-        m_castlings = 0;
-        m_ep        = 0;
-        m_fifty     = 0;
-        m_hash      = 0;
-
-        m_mv.reset();
-
-#if !defined(PURE_HCE)
         std::memset(&accumulator.accumulation,     0, sizeof(accumulator.accumulation));
         std::memset(&accumulator.psqtAccumulation, 0, sizeof(accumulator.psqtAccumulation));
 
@@ -133,11 +121,30 @@ struct Undo
         for (unsigned int i = 0; i < sizeof(dirtyPiece.new_piece) / sizeof(ExtPieceSquare); ++i)
             for (unsigned int j = 0; j < sizeof(dirtyPiece.new_piece[i].from) / sizeof(PieceSquare); ++j)
                 dirtyPiece.new_piece[i].from[j] = PS_NONE;
-#endif
 
         previous = nullptr;
     }
 };
+#endif
+
+struct Undo
+{
+    U8   m_castlings;
+    FLD  m_ep;
+    int  m_fifty;
+    U64  m_hash;
+    Move m_mv;
+
+    void reset()
+    {
+        m_castlings = 0;
+        m_ep        = 0;
+        m_fifty     = 0;
+        m_hash      = 0;
+
+        m_mv.reset();
+    }
+};
 
 class Position
 {
@@ -156,6 +163,8 @@ public:
     FORCE_INLINE U64 Hash() const { return m_hash ^ s_hashSide[m_side] ^ s_hashCastlings[m_castlings] ^ s_hashEP[m_ep]; }
     bool   InCheck() const { return IsAttacked(King(m_side), m_side ^ 1); }
     bool   IsAttacked(FLD f, COLOR side) const;
+    bool   isPseudoLegal(Move mv) const;
+    bool   isLegal(Move mv) const;
     FLD    King(COLOR side) const { return m_Kings[side]; }
     Move   LastMove() const { return (m_undoSize > 0)? m_undos[m_undoSize - 1].m_mv : Move(); }
     bool   MakeMove(Move mv);
@@ -178,13 +187,12 @@ public:
     EVAL nonPawnMaterial(COLOR side);
     Move getRandomMove();
 
-    Undo * state() const { return m_state; }
-    Undo * m_state;
 #if !defined(PURE_HCE)
+    NnueState * state() const { return m_state; }
     const EvalList * eval_list() const;
     inline PieceId piece_id_on(Square sq) const;
     std::uint32_t getActiveIndexes(COLOR c, std::uint32_t indexes[]);
-    std::pair<std::uint32_t, std::uint32_t> getChangedIndexes(COLOR c, std::uint32_t added[], std::uint32_t removed[]);
+    std::pair<std::uint32_t, std::uint32_t> getChangedIndexes(COLOR c, const DirtyPiece & dp, std::uint32_t added[], std::uint32_t removed[]);
     inline std::uint32_t makeIndex(Square sq_k, Square sq, Piece p, COLOR c);
 #endif
 
@@ -223,6 +231,16 @@ private:
     bool m_initialPosition;
 #if !defined(PURE_HCE)
     EvalList evalList;
+
+    //
+    //  the state after m_undoSize moves lives in m_states[m_undoSize % MAX_STATES]. Only the
+    //  search depth (MAX_PLY) is ever walked back, so the ring leaves a margin over it and
+    //  game moves older than that are simply overwritten
+    //
+
+    enum { MAX_STATES = 256 };
+    NnueState m_states[MAX_STATES];
+    NnueState * m_state;
 #endif
 };
 
@@ -28,6 +28,7 @@
 #endif
 #include "history.h"
 #include "moveeval.h"
+#include "movepicker.h"
 
 #include <algorithm>
 #include <chrono>
@@ -42,15 +43,29 @@
 /*static */constexpr int Search::m_fmpHistoryLimit[2];
 /*static */constexpr int Search::m_fpHistoryLimit[2];
 
+void SearchStats::reset()
+{
+    m_nodes.store(0, std::memory_order_relaxed);
+    m_qNodes.store(0, std::memory_order_relaxed);
+    m_tbHits.store(0, std::memory_order_relaxed);
+    m_ttHits.store(0, std::memory_order_relaxed);
+    m_cutoffs.store(0, std::memory_order_relaxed);
+    m_selDepth.store(0, std::memory_order_relaxed);
+}
+
 Search::Search() :
-    m_nodes(0),
-    m_tbHits(0),
-    m_limitCheck(1023),
+    m_nodesLeft(0),
+    m_nodesBudget(nullptr),
+    m_nodesCheck(0),
     m_t0(0),
     m_flags(0),
     m_depth(0),
     m_syzygyDepth(0),
-    m_selDepth(0),
+    m_rootMovesSize(0),
+    m_pvIdx(0),
+    m_multiPV(1),
+    m_qHashKb(0),
+    m_searchMovesSize(0),
     m_principalSearcher(false),
     m_thc(0),
     m_threads(nullptr),
@@ -59,6 +74,8 @@ Search::Search() :
     m_smpThreadExit(false),
     m_lazyPonder(false),
     m_terminateSmp(false),
+    m_timerExit(false),
+    m_stopTime(0),
     m_level(DEFAULT_LEVEL),
     m_ponderHit(false),
     m_score(-CHECKMATE_SCORE),
@@ -78,35 +95,123 @@ Search::~Search()
     releaseHelperThreads();
 }
 
-bool Search::checkLimits()
+//
+//  The search threads only test m_flags and their node budget, the clock is watched by
+//  the timer thread of the principal searcher, started for the duration of startSearch
+//
+
+void Search::startTimer()
 {
-    if (m_flags & SEARCH_TERMINATED)
-        return true;
+    m_timerExit = false;
+    m_timer = std::thread(&Search::timerRoutine, this);
+}
 
-    if (m_smpThreadExit) {
-        m_flags |= TERMINATED_BY_LIMIT;
-        return true;
+void Search::stopTimer()
+{
+    if (!m_timer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk(m_stopMutex);
+        m_timerExit = true;
     }
 
-    if (m_time.getTimeMode() == Time::TimeControl::NodesLimit) {
-        if (m_nodes >= m_time.getNodesLimit())
-            m_flags |= TERMINATED_BY_LIMIT;
+    m_stopcv.notify_one();
+    m_timer.join();
+}
+
+SearchTotals Search::aggregateStats() const
+{
+    SearchTotals totals;
 
-        return (m_flags & SEARCH_TERMINATED);
+    for (unsigned int i = 0; i <= m_thc; ++i) {
+        const auto & stats = i < m_thc ? m_threadParams[i].m_stats : m_stats;
+
+        totals.m_nodes    += stats.m_nodes.load(std::memory_order_relaxed);
+        totals.m_qNodes   += stats.m_qNodes.load(std::memory_order_relaxed);
+        totals.m_tbHits   += stats.m_tbHits.load(std::memory_order_relaxed);
+        totals.m_ttHits   += stats.m_ttHits.load(std::memory_order_relaxed);
+        totals.m_cutoffs  += stats.m_cutoffs.load(std::memory_order_relaxed);
+        totals.m_selDepth  = std::max(totals.m_selDepth, stats.selDepth());
     }
 
-    ++m_limitCheck;
+    return totals;
+}
+
+//
+//  Called by every searcher whenever its own count reaches the nodes it has claimed. The go
+//  nodes budget is shared by all threads and handed out in chunks that shrink towards the
+//  limit, so together they never search past it. A thread stops once nothing is left, the
+//  total falls short only by the few nodes helpers have claimed but not searched when the
+//  principal searcher stops them. Nodes entered past the budget return at once and are not
+//  counted
+//
+
+void Search::claimNodes()
+{
+    NODES left = m_nodesBudget->load(std::memory_order_relaxed);
+    NODES claim;
+
+    do {
+        // the root node is counted without a check, it is paid for here
+        NODES owed = m_stats.nodes() - m_nodesCheck;
+
+        if (left <= owed) {
+            m_nodesCheck += m_nodesBudget->exchange(0, std::memory_order_relaxed);
+            m_stats.m_nodes.store(m_nodesCheck, std::memory_order_relaxed);
+
+            if (!(m_flags & SEARCH_TERMINATED))
+                m_stopTime = GetProcTime();
+
+            m_flags |= TERMINATED_BY_LIMIT;
+            return;
+        }
+
+        claim = owed + std::min<NODES>(std::max<NODES>((left - owed) / 64, 1), 1024);
+    } while (!m_nodesBudget->compare_exchange_weak(left, left - claim, std::memory_order_relaxed));
+
+    m_nodesCheck += claim;
+}
+
+void Search::timerRoutine()
+{
+    std::unique_lock<std::mutex> lk(m_stopMutex);
+
+    while (!m_timerExit && !(m_flags & SEARCH_TERMINATED)) {
+
+        //
+        //  sleep until the hard limit. Without one (analysis, pondering, depth and node
+        //  limits) wait for a ponderhit
+        //
 
-    if (!(m_limitCheck &= 1023)) {
+        if ((m_flags & MODE_PLAY) && m_time.getTimeMode() == Time::TimeControl::TimeLimit) {
+            U32 dt = GetProcTime() - m_t0;
 
-        U32 dt = GetProcTime() - m_t0;
-        if (m_flags & MODE_PLAY) {
-            if (m_time.getTimeMode() == Time::TimeControl::TimeLimit && dt >= m_time.getHardLimit())
+            if (dt >= m_time.getHardLimit()) {
+                m_stopTime = GetProcTime();
                 m_flags |= TERMINATED_BY_LIMIT;
+                break;
+            }
+
+            m_stopcv.wait_for(lk, std::chrono::milliseconds(m_time.getHardLimit() - dt));
         }
+        else
+            m_stopcv.wait(lk);
+    }
+}
+
+void Search::raiseStop(U8 flags)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_stopMutex);
+
+        if (!(m_flags & SEARCH_TERMINATED))
+            m_stopTime = GetProcTime();
+
+        m_flags |= flags;
     }
 
-    return (m_flags & SEARCH_TERMINATED);
+    m_stopcv.notify_all();
 }
 
 bool Search::isDraw()
@@ -122,6 +227,125 @@ bool Search::isDraw()
     return false;
 }
 
+void Search::initRootMoves()
+{
+    MoveList mvlist;
+    GenLegalMoves(m_position, mvlist);
+
+    m_rootMovesSize = mvlist.Size();
+    m_pvIdx = 0;
+
+    //
+    //  keep only the moves of go searchmoves, unless none of them is legal here
+    //
+
+    if (m_searchMovesSize) {
+        size_t kept = 0;
+
+        for (size_t i = 0; i < m_rootMovesSize; ++i) {
+            if (std::find(m_searchMoves, m_searchMoves + m_searchMovesSize, mvlist[i].m_mv) != m_searchMoves + m_searchMovesSize)
+                mvlist.Swap(kept++, i);
+        }
+
+        if (kept)
+            m_rootMovesSize = kept;
+    }
+
+    //
+    //  until the first iteration has scores, the hash move goes first
+    //
+
+    TEntry hEntry{};
+    EVAL ttEval;
+    Move hashMove = ProbeHash(hEntry, m_position.Hash(), ttEval) ? Move(hEntry.m_data.move) : Move{};
+
+    for (size_t i = 0; i < m_rootMovesSize; ++i) {
+        if (mvlist[i].m_mv == hashMove) {
+            mvlist.Swap(0, i);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < m_rootMovesSize; ++i) {
+        auto & rm = m_rootMoves[i];
+
+        rm.m_mv = mvlist[i].m_mv;
+        rm.m_score = rm.m_prevScore = -CHECKMATE_SCORE;
+        rm.m_depth = rm.m_selDepth = 0;
+        rm.m_nodes = rm.m_prevNodes = 0;
+        rm.m_pv[0] = rm.m_mv;
+        rm.m_pvSize = 1;
+    }
+}
+
+//
+//  Order for the next iteration: scored moves by score, the moves that failed low by the
+//  effort they took last time, which is a good predictor of how close they came
+//
+
+void Search::sortRootMoves()
+{
+    for (size_t i = 0; i < m_rootMovesSize; ++i) {
+        auto & rm = m_rootMoves[i];
+
+        rm.m_prevScore = rm.m_score;
+        rm.m_prevNodes = rm.m_nodes;
+        rm.m_nodes = 0;
+    }
+
+    std::stable_sort(m_rootMoves, m_rootMoves + m_rootMovesSize, [](const RootMove & a, const RootMove & b) {
+        if (a.m_prevScore != b.m_prevScore)
+            return a.m_prevScore > b.m_prevScore;
+        return a.m_prevNodes > b.m_prevNodes;
+    });
+}
+
+RootMove * Search::findRootMove(Move mv)
+{
+    for (size_t i = 0; i < m_rootMovesSize; ++i) {
+        if (m_rootMoves[i].m_mv == mv)
+            return &m_rootMoves[i];
+    }
+
+    return nullptr;
+}
+
+void Search::updateRootMove(Move mv, EVAL score, bool pvMove, NODES nodes)
+{
+    auto rm = findRootMove(mv);
+
+    if (!rm)
+        return;
+
+    rm->m_nodes += nodes;
+
+    if (!pvMove) {
+        rm->m_score = -CHECKMATE_SCORE;
+        return;
+    }
+
+    rm->m_score = score;
+    rm->m_depth = m_depth;
+    rm->m_selDepth = m_stats.selDepth();
+    rm->m_pv[0] = mv;
+    memcpy(rm->m_pv + 1, m_pv[1], m_pvSize[1] * sizeof(Move));
+    rm->m_pvSize = 1 + m_pvSize[1];
+}
+
+//
+//  Share of the root nodes of the last iteration spent under the best move
+//
+
+double Search::bestMoveEffort() const
+{
+    NODES total = 0;
+
+    for (size_t i = 0; i < m_rootMovesSize; ++i)
+        total += m_rootMoves[i].m_nodes;
+
+    return total ? static_cast<double>(m_rootMoves[0].m_nodes) / total : 0.0;
+}
+
 EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bool rootNode, bool cutNode, Move skipMove/*= 0*/)
 {
     //
@@ -139,9 +363,9 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
     const U64 hash = m_position.Hash() ^ skipKey;
     TTable::instance().prefetchEntry(hash);
 
-    ++m_nodes;
+    m_stats.bump(m_stats.m_nodes);
+    m_stats.updateSelDepth(ply);
     m_pvSize[ply]  = 0;
-    m_selDepth     = std::max(ply, m_selDepth);
 
     if (!rootNode) {
 
@@ -170,8 +394,9 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
     TEntry hEntry{};
 
     EVAL ttScore = 0;
+    EVAL ttEval  = TT_NO_EVAL;
     auto onPV    = (beta - alpha > 1);
-    auto ttHit   = ProbeHash(hEntry, hash);
+    auto ttHit   = ProbeHash(hEntry, hash, ttEval);
 
     if (ttHit) {
         ttScore = hEntry.m_data.score;
@@ -224,7 +449,7 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
                 m_position.Side() == WHITE);
 
             if (probe != TB_RESULT_FAILED) {
-                m_tbHits++;
+                m_stats.bump(m_stats.m_tbHits);
                 switch (probe)
                 {
                 case TB_WIN:
@@ -254,8 +479,17 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
     }
 #endif
 
+    //
+    //  a hash hit carries the static evaluation, so the network only runs for new positions
+    //
+
     auto inCheck     = m_position.InCheck();
-    EVAL staticEval  = inCheck ? -CHECKMATE_SCORE + ply : (isNull ? -m_evalStack[ply - 1] + 2 * Evaluator::Tempo : m_evaluator->evaluate(m_position));
+    EVAL rawEval     = ttEval;
+
+    if (!inCheck && !isNull && rawEval == TT_NO_EVAL)
+        rawEval = m_evaluator->evaluateRaw(m_position);
+
+    EVAL staticEval  = inCheck ? -CHECKMATE_SCORE + ply : (isNull ? -m_evalStack[ply - 1] + 2 * Evaluator::Tempo : Evaluator::fromRaw(m_position, rawEval));
     EVAL bestScore   = staticEval;
 
     m_evalStack[ply] = staticEval;
@@ -321,13 +555,10 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
 
         if (depth >= 5 && !(ttHit && hEntry.m_data.depth >= (depth - 4) && ttScore < betaCut)) {
             MoveList captureMoves;
+            MovePicker capturePicker(this, captureMoves, hashMove, ply, false, true);
+            Move captureMove;
 
-            GenCapturesAndPromotions(m_position, captureMoves);
-            MoveEval::sortMoves(this, captureMoves, hashMove, ply);
-
-            auto captureMovesSize = captureMoves.Size();
-            for (size_t i = 0; i < captureMovesSize; ++i) {
-                const Move captureMove = MoveEval::getNextBest(captureMoves, i);
+            while ((captureMove = capturePicker.nextMove())) {
 
                 if (skipMove == captureMove)
                     continue;
@@ -336,6 +567,7 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
                     continue;
 
                 if (m_position.MakeMove(captureMove)) {
+                    m_evaluator->prefetch(m_position);
 
                     auto score = -qSearch(-betaCut, -betaCut + 1, ply, 0);
 
@@ -366,23 +598,26 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
     const auto ttCapture = hashMove && hashMove.Captured();
 
     auto & mvlist = ply == m_singularPly ? m_singularLists[ply] : m_lists[ply];
+    MovePicker picker(this, mvlist, hashMove, ply, inCheck);
+    Move mv;
 
-    if (inCheck)
-        GenMovesInCheck(m_position, mvlist);
-    else
-        GenAllMoves(m_position, mvlist);
+    //
+    //  the root walks its own table: ordered between iterations, without the moves of
+    //  the MultiPV lines found above the current one
+    //
 
-    MoveEval::sortMoves(this, mvlist, hashMove, ply);
-    auto mvSize = mvlist.Size();
+    size_t rootIdx = m_pvIdx;
+    auto nextMove = [&]() {
+        if (rootNode)
+            return rootIdx < m_rootMovesSize ? m_rootMoves[rootIdx++].m_mv : Move{};
+        return picker.nextMove();
+    };
 
     MoveList quietMoves;
     m_killerMoves[ply + 1][0] = m_killerMoves[ply + 1][1] = 0;
     auto quietsTried = 0;
-    auto skipQuiets = false;
-
-    for (size_t i = 0; i < mvSize; ++i) {
 
-        Move mv = MoveEval::getNextBest(mvlist, i);
+    while ((mv = nextMove())) {
 
         if (mv == skipMove)
             continue;
@@ -393,22 +628,6 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
         if (!rootNode && bestScore > MATED_IN_MAX) {
 
             if (quietMove) {
-                if (skipQuiets) {
-                    bool tacticalMoveLeft = false;
-                    for (size_t j = i + 1; j < mvSize; ++j) {
-                        const Move tailMove = mvlist[j].m_mv;
-                        if (tailMove != skipMove && MoveEval::isTacticalMove(tailMove)) {
-                            tacticalMoveLeft = true;
-                            break;
-                        }
-                    }
-
-                    if (!tacticalMoveLeft)
-                        break;
-
-                    continue;
-                }
-
                 History::fetchHistory(this, mv, ply, history);
 
                 if (depth <= m_cmpDepth[improving] && history.cmhistory < m_cmpHistoryLimit[improving])
@@ -423,10 +642,10 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
                     && futilityMargin <= alpha
                     && depth <= 8
                     && history.history + history.cmhistory + history.fmhistory < m_fpHistoryLimit[improving])
-                    skipQuiets = true;
+                    picker.skipQuiets();
 
                 if (depth <= m_lmpDepth && quietsTried >= m_lmpPruningTable[improving][depth])
-                    skipQuiets = true;
+                    picker.skipQuiets();
             }
 
             if (depth <= 8 && !inCheck) {
@@ -439,7 +658,7 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
                 seeMargin[0] = SEENoisyMargin * depth * depth;
                 seeMargin[1] = SEEQuietMargin * depth;
 
-                const auto sortScore = mvlist[i].m_score;
+                const auto sortScore = picker.lastScore();
                 const EVAL see = MoveEval::seeCached(mv, sortScore) ? MoveEval::cachedSee(sortScore) : MoveEval::SEE(this, mv);
 
                 if (see < seeMargin[quietMove])
@@ -477,8 +696,11 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
             quietMoves.Add(mv);
         }
 
+        const auto nodesBefore = m_stats.nodes();
+
         if (m_position.MakeMove(mv)) {
             ++legalMoves;
+            m_evaluator->prefetch(m_position);
 
             m_moveStack[ply]  = mv;
             m_pieceStack[ply] = mv.Piece();
@@ -533,6 +755,9 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
             if (m_flags & SEARCH_TERMINATED)
                 return DRAW_SCORE;
 
+            if (rootNode)
+                updateRootMove(mv, e, legalMoves == 1 || e > alpha, m_stats.nodes() - nodesBefore);
+
             if (e > bestScore) {
                 bestScore = e;
                 if (e > alpha) {
@@ -545,6 +770,7 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
                     m_pvSize[ply] = 1 + m_pvSize[ply + 1];
 
                     if (alpha >= beta) {
+                        m_stats.bump(m_stats.m_cutoffs);
                         type = HASH_BETA;
                         if (quietMove) {
                             History::updateHistory(this, quietMoves, ply, depth * depth);
@@ -568,22 +794,32 @@ EVAL Search::abSearch(EVAL alpha, EVAL beta, int depth, int ply, bool isNull, bo
 
     assert((m_position.Fifty() >= 100) == false); // we must cut off at the begining of a node search for draws
 
-    TTable::instance().record(bestMove, bestScore, depth, ply, type, hash);
+    //
+    //  a secondary MultiPV line is the best move of a restricted root, not of the position
+    //
+
+    if (!(rootNode && m_pvIdx))
+        TTable::instance().record(bestMove, bestScore, depth, ply, type, hash, rawEval);
 
     return bestScore;
 }
 
 EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* = false*/)
 {
-    ++m_nodes;
+    m_stats.bump(m_stats.m_nodes);
+    m_stats.bump(m_stats.m_qNodes);
+    m_stats.updateSelDepth(ply);
     m_pvSize[ply]   = 0;
-    m_selDepth      = std::max(ply, m_selDepth);
 
     if (checkLimits())
         return DRAW_SCORE;
 
     const U64 hash = m_position.Hash();
-    TTable::instance().prefetchEntry(hash);
+
+    if (m_qtable.enabled())
+        m_qtable.prefetchEntry(hash);
+    else
+        TTable::instance().prefetchEntry(hash);
 
     if ((ply > MAX_PLY - 2) || isDraw())
         return ((ply > MAX_PLY - 2) && !m_position.InCheck()) ? m_evaluator->evaluate(m_position) : DRAW_SCORE;
@@ -591,10 +827,11 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
     Move hashMove{};
     TEntry hEntry{};
     EVAL ttScore;
+    EVAL ttEval = TT_NO_EVAL;
 
     auto inCheck = m_position.InCheck();
     auto tteDepth = inCheck || depth >= 0 ? 0 : -1;
-    auto ttHit = ProbeHash(hEntry, hash);
+    auto ttHit = ProbeQHash(hEntry, hash, ttEval);
 
     if (ttHit) {
         ttScore = hEntry.m_data.score;
@@ -615,6 +852,7 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
     }
 
     EVAL bestScore;
+    EVAL rawEval = ttEval;
 
     if (inCheck)
     {
@@ -622,7 +860,10 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
     }
     else
     {
-        bestScore = (isNull ? -m_evalStack[ply - 1] + 2 * Evaluator::Tempo : m_evaluator->evaluate(m_position));
+        if (!isNull && rawEval == TT_NO_EVAL)
+            rawEval = m_evaluator->evaluateRaw(m_position);
+
+        bestScore = (isNull ? -m_evalStack[ply - 1] + 2 * Evaluator::Tempo : Evaluator::fromRaw(m_position, rawEval));
 
         if (ttHit) {
             if ((hEntry.m_data.type == HASH_BETA && ttScore > bestScore)  ||
@@ -633,7 +874,7 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
 
         if (bestScore >= beta) {
             if (!ttHit)
-                TTable::instance().record(0, bestScore, -5, ply, HASH_BETA, hash);
+                RecordQHash(0, bestScore, -5, ply, HASH_BETA, hash, rawEval);
             return bestScore;
         }
 
@@ -642,21 +883,14 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
     }
 
     auto & mvlist = ply == m_singularPly ? m_singularLists[ply] : m_lists[ply];
-
-    if (inCheck)
-        GenMovesInCheck(m_position, mvlist);
-    else
-        GenCapturesAndPromotions(m_position, mvlist);
-
-    MoveEval::sortMoves(this, mvlist, hashMove, ply);
-    auto mvSize = mvlist.Size();
+    MovePicker picker(this, mvlist, hashMove, ply, inCheck, true);
+    Move mv;
     Move bestMove = hashMove;
     U8 type = HASH_ALPHA;
 
-    for (size_t i = 0; i < mvSize; ++i) {
-        Move mv = MoveEval::getNextBest(mvlist, i);
+    while ((mv = picker.nextMove())) {
 
-        const auto sortScore = mvlist[i].m_score;
+        const auto sortScore = picker.lastScore();
 
         if (!inCheck) {
             if (MoveEval::seeCached(mv, sortScore)) {
@@ -670,6 +904,7 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
         }
 
         if (m_position.MakeMove(mv)) {
+            m_evaluator->prefetch(m_position);
 
             auto e = -qSearch(-beta, -alpha, ply + 1, depth - 1);
             m_position.UnmakeMove();
@@ -693,7 +928,7 @@ EVAL Search::qSearch(EVAL alpha, EVAL beta, int ply, int depth, bool isNull/* =
         }
     }
 
-    TTable::instance().record(bestMove, bestScore, tteDepth, ply, type, hash);
+    RecordQHash(bestMove, bestScore, tteDepth, ply, type, hash, rawEval);
     return bestScore;
 }
 
@@ -750,24 +985,11 @@ void Search::clearStacks()
 bool Search::isGameOver(Position & pos, std::string & result, std::string & comment, Move & bestMove, int & legalMoves)
 {
     MoveList mvlist;
-    GenAllMoves(pos, mvlist);
-    legalMoves = 0;
-    auto mvSize = mvlist.Size();
-    Move mv{};
-    Move lastLegal{};
+    GenLegalMoves(pos, mvlist);
+    legalMoves = static_cast<int>(mvlist.Size());
 
-    for (size_t i = 0; i < mvSize; ++i) {
-        mv = mvlist[i].m_mv;
-        if (pos.MakeMove(mv)) {
-            ++legalMoves;
-            lastLegal = mv;
-            bestMove  = lastLegal;
-            pos.UnmakeMove();
-
-            if (legalMoves > 1)
-                break;
-        }
-    }
+    if (legalMoves)
+        bestMove = mvlist[0].m_mv;
 
     if (pos.Count(PW) == 0 && pos.Count(PB) == 0) {
         if (pos.MatIndex(WHITE) < 5 && pos.MatIndex(BLACK) < 5)
@@ -778,10 +1000,7 @@ bool Search::isGameOver(Position & pos, std::string & result, std::string & comm
         }
     }
 
-    if (legalMoves == 1) {
-        bestMove = lastLegal;
-    }
-    else if (legalMoves == 0) {
+    if (legalMoves == 0) {
         if (pos.InCheck())
         {
             if (pos.Side() == WHITE) {
@@ -818,12 +1037,15 @@ bool Search::isGameOver(Position & pos, std::string & result, std::string & comm
     return false;
 }
 
-void Search::printPV(const Position& pos, int iter, int selDepth, EVAL score, const Move* pv, int pvSize, Move mv, uint64_t sumNodes, uint64_t sumHits, uint64_t nps)
+void Search::printPV(const Position& pos, int iter, int selDepth, EVAL score, const Move* pv, int pvSize, Move mv, uint64_t sumNodes, uint64_t sumHits, uint64_t nps, int multiPV/* = 0*/)
 {
     auto dt = GetProcTime() - m_t0;
 
     std::cout << "info depth " << iter << " seldepth " << selDepth;
 
+    if (multiPV)
+        std::cout << " multipv " << multiPV;
+
     if (abs(score) >= (CHECKMATE_SCORE - MAX_PLY))
         std::cout << " score mate" << ((score >= 0) ? " " : " -") << ((CHECKMATE_SCORE - abs(score)) / 2) + 1;
     else
@@ -836,6 +1058,7 @@ void Search::printPV(const Position& pos, int iter, int selDepth, EVAL score, co
     if (nps)
         std::cout << " nps " << nps;
 
+    std::cout << " hashfull " << TTable::instance().hashfull();
     std::cout << " pv";
 
     if (pvSize > 0) {
@@ -848,9 +1071,35 @@ void Search::printPV(const Position& pos, int iter, int selDepth, EVAL score, co
     std::cout << std::endl;
 }
 
-bool Search::ProbeHash(TEntry & hentry, U64 hash)
+bool Search::ProbeHash(TEntry & hentry, U64 hash, EVAL & staticEval)
+{
+    if (!TTable::instance().retrieve(hash, hentry, staticEval))
+        return false;
+
+    m_stats.bump(m_stats.m_ttHits);
+    return true;
+}
+
+//
+//  quiescence nodes look in their own table first, then in the shared one for a deeper result
+//
+
+bool Search::ProbeQHash(TEntry & hentry, U64 hash, EVAL & staticEval)
+{
+    if (m_qtable.enabled() && m_qtable.retrieve(hash, hentry, staticEval)) {
+        m_stats.bump(m_stats.m_ttHits);
+        return true;
+    }
+
+    return ProbeHash(hentry, hash, staticEval);
+}
+
+void Search::RecordQHash(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash, EVAL staticEval)
 {
-    return TTable::instance().retrieve(hash, hentry);
+    if (m_qtable.enabled())
+        m_qtable.record(mv, score, depth, ply, type, hash, staticEval);
+    else
+        TTable::instance().record(mv, score, depth, ply, type, hash, staticEval);
 }
 
 #if defined (SYZYGY_SUPPORT)
@@ -923,10 +1172,7 @@ Move Search::tableBaseRootSearch()
     //
 
     MoveList moves;
-    if (m_position.InCheck())
-        GenMovesInCheck(m_position, moves);
-    else
-        GenAllMoves(m_position, moves);
+    GenLegalMoves(m_position, moves);
 
     auto mvSize = moves.Size();
     for (size_t i = 0; i < mvSize; ++i) {
@@ -944,13 +1190,12 @@ void Search::startWorkerThreads(Time time)
     for (unsigned int i = 0; i < m_thc; ++i) {
         m_threadParams[i].m_readyMutex.lock();
 
-        m_threadParams[i].m_nodes = 0;
-        m_threadParams[i].m_selDepth = 0;
-        m_threadParams[i].m_tbHits = 0;
+        m_threadParams[i].m_stats.reset();
         m_threadParams[i].setTime(time);
         m_threadParams[i].setLevel(m_level);
         m_threadParams[i].m_t0 = m_t0;
-        m_threadParams[i].m_flags = m_flags;
+        m_threadParams[i].m_flags = m_flags.load();
+        m_threadParams[i].m_nodesBudget = m_nodesBudget;
         m_threadParams[i].m_smpThreadExit = false;
 
         m_threadParams[i].m_lazyDepth = 1;
@@ -973,8 +1218,10 @@ void Search::stopWorkerThreads()
     indicateWorkersStop();
 
     for (unsigned int i = 0; i < m_thc; ++i) {
-        while (m_threadParams[i].m_lazyDepth)
-            ;
+        auto & worker = m_threadParams[i];
+
+        std::unique_lock<std::mutex> lk(worker.m_readyMutex);
+        worker.m_donecv.wait(lk, [&worker] { return !worker.m_lazyDepth; });
     }
 }
 
@@ -983,14 +1230,18 @@ void Search::waitUntilCompletion()
     if (!m_principalSearcher)
         return;
 
-    while ((m_flags & MODE_ANALYZE) && (m_flags & SEARCH_TERMINATED) == 0)
-        ; // we must wait explicitely for stop command or a ponderhit
+    //
+    //  we must wait explicitely for stop command or a ponderhit
+    //
+
+    std::unique_lock<std::mutex> lk(m_stopMutex);
+    m_stopcv.wait(lk, [this] { return !(m_flags & MODE_ANALYZE) || (m_flags & SEARCH_TERMINATED); });
 }
 
 void Search::isReady()
 {
     indicateWorkersStop();
-    m_flags |= TERMINATED_BY_USER;
+    raiseStop(TERMINATED_BY_USER);
     std::unique_lock<std::mutex> lk(m_readyMutex);
     std::cout << "readyok" << std::endl;
 }
@@ -998,7 +1249,7 @@ void Search::isReady()
 void Search::stopPrincipalSearch()
 {
     m_ponderHit = false;
-    m_flags |= TERMINATED_BY_USER;
+    raiseStop(TERMINATED_BY_USER);
 }
 
 void Search::startPrincipalSearch(Time time, bool ponder)
@@ -1018,10 +1269,15 @@ void Search::startPrincipalSearch(Time time, bool ponder)
 
 uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench)
 {
-    m_nodes = 0;
-    m_selDepth = 0;
-    m_tbHits = 0;
-    m_limitCheck = 1023;
+    //
+    //  a table cleared by ucinewgame may still be zeroed in the background
+    //
+
+    if (m_principalSearcher || bench)
+        TTable::instance().finishZeroing();
+
+    m_stats.reset();
+    m_stopTime = 0;
 
     if (!m_ponderHit) {
         m_t0 = GetProcTime();
@@ -1047,11 +1303,31 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
     memset(&m_pv, 0, sizeof(m_pv));
     m_time.resetAdjustment();
 
+    //
+    //  helpers are handed the budget of the principal searcher when they are started
+    //
+
+    if (m_principalSearcher || bench) {
+        const bool nodesLimit = m_principalSearcher && m_time.getTimeMode() == Time::TimeControl::NodesLimit;
+        m_nodesLeft = nodesLimit ? m_time.getNodesLimit() : 0;
+        m_nodesBudget = nodesLimit ? &m_nodesLeft : nullptr;
+    }
+
+    m_nodesCheck = 0;
+
     m_ponder = 0;
     m_best   = 0;
 
     auto printBestMove = [](Search * pthis, Position & pos, Move m, Move p) {
 
+#if !defined(NDEBUG)
+        if (pthis->m_stopTime)
+            std::cout << "info string stop latency " << GetProcTime() - pthis->m_stopTime << " ms" << std::endl;
+#endif
+
+        if (TTable::instance().statsEnabled())
+            std::cout << "info string " << TTable::instance().statsReport() << std::endl;
+
         if (m)
             std::cout << "bestmove " << MoveToStrLong(m);
 
@@ -1079,10 +1355,10 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
 
 #if defined (SYZYGY_SUPPORT)
         //
-        //  Probe tablebases/tt at root
+        //  Probe tablebases/tt at root, the probe knows nothing about searchmoves
         //
 
-        auto bestTb = tableBaseRootSearch();
+        auto bestTb = m_searchMovesSize ? Move{} : tableBaseRootSearch();
 
         if (bestTb) {
             waitUntilCompletion();
@@ -1101,6 +1377,12 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
     m_score = DRAW_SCORE;
     auto maxDepth = m_level == MAX_LEVEL ? MAX_PLY : ((MAX_PLY * m_level) / MAX_LEVEL);
 
+    initRootMoves();
+    auto multiPV = std::min(static_cast<size_t>(m_multiPV), m_rootMovesSize);
+
+    if (m_principalSearcher && m_searchMovesSize)
+        m_best = m_rootMoves[0].m_mv;
+
     //
     //  Start worker threads if Threads option is configured
     //
@@ -1108,86 +1390,97 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
     if (m_thc)
         startWorkerThreads(time);
 
+    if (m_principalSearcher)
+        startTimer();
+
     uint64_t sumNodes = 0;
     uint64_t sumHits = 0;
     uint64_t nps = 0;
 
-    Move prevBest{};
-    int bestMoveStability = 0;
-
     for (m_depth = depth; m_depth < maxDepth; ++m_depth) {
 
+        sortRootMoves();
+
         //
-        //  Make a search
+        //  Make a search for every MultiPV line, each one excluding the moves found above it
         //
 
-        EVAL aspiration = m_depth >= 4 ? 5 : CHECKMATE_SCORE;
+        for (m_pvIdx = 0; m_pvIdx < multiPV; ++m_pvIdx) {
 
-        EVAL alpha = std::max(m_score - aspiration, -CHECKMATE_SCORE);
-        EVAL beta  = std::min(m_score + aspiration, CHECKMATE_SCORE);
+            EVAL score = m_pvIdx ? m_rootMoves[m_pvIdx].m_prevScore : m_score;
+            EVAL aspiration = (m_depth >= 4 && score != -CHECKMATE_SCORE) ? 5 : CHECKMATE_SCORE;
 
-        while (aspiration <= CHECKMATE_SCORE) {
-            auto score = abSearch(alpha, beta, m_depth, 0, false, true, false);
+            EVAL alpha = std::max(score - aspiration, -CHECKMATE_SCORE);
+            EVAL beta  = std::min(score + aspiration, CHECKMATE_SCORE);
 
-            if (m_flags & SEARCH_TERMINATED)
-                break;
+            while (aspiration <= CHECKMATE_SCORE) {
+                score = abSearch(alpha, beta, m_depth, 0, false, true, false);
+
+                if (m_flags & SEARCH_TERMINATED)
+                    break;
 
-            m_score = score;
+                std::stable_sort(m_rootMoves + m_pvIdx, m_rootMoves + m_rootMovesSize, [](const RootMove & a, const RootMove & b) {
+                    return a.m_score > b.m_score;
+                });
 
-            if (m_pvSize[0] && m_pv[0][0]) {
-                m_best = m_pv[0][0];
+                if (!m_pvIdx) {
+                    m_score = score;
 
-                if (m_pvSize[0] > 1 && m_pv[0][1]) {
-                    m_ponder = m_pv[0][1];
-                    memcpy(m_pvPrev, m_pv, sizeof(m_pv));
-                    memcpy(m_pvSizePrev, m_pvSize, sizeof(m_pvSize));
+                    if (m_pvSize[0] && m_pv[0][0]) {
+                        m_best = m_pv[0][0];
+
+                        if (m_pvSize[0] > 1 && m_pv[0][1]) {
+                            m_ponder = m_pv[0][1];
+                            memcpy(m_pvPrev, m_pv, sizeof(m_pv));
+                            memcpy(m_pvSizePrev, m_pvSize, sizeof(m_pvSize));
+                        }
+                        else
+                            m_ponder = 0;
+                    }
                 }
+
+                aspiration += 2 + aspiration / 2;
+                if (score <= alpha)
+                {
+                    beta = (alpha + beta) / 2;
+                    alpha = std::max(score - aspiration, -CHECKMATE_SCORE);
+                }
+                else if (score >= beta)
+                    beta = std::min(score + aspiration, CHECKMATE_SCORE);
                 else
-                    m_ponder = 0;
+                    break;
             }
 
-            aspiration += 2 + aspiration / 2;
-            if (m_score <= alpha)
-            {
-                beta = (alpha + beta) / 2;
-                alpha = std::max(m_score - aspiration, -CHECKMATE_SCORE);
-            }
-            else if (m_score >= beta)
-                beta = std::min(m_score + aspiration, CHECKMATE_SCORE);
-            else
+            if (m_flags & SEARCH_TERMINATED)
                 break;
         }
 
+        m_pvIdx = 0;
+
         if (m_flags & SEARCH_TERMINATED)
             break;
 
-        //
-        //  Track how many consecutive iterations kept the same best move
-        //
-
-        if (m_best && m_best == prevBest)
-            bestMoveStability = std::min(bestMoveStability + 1, 10);
-        else {
-            prevBest = m_best;
-            bestMoveStability = 0;
-        }
-
         //
         //  Update node statistic from all workers
         //
 
         if (m_principalSearcher) {
-            sumNodes = m_nodes;
-            sumHits = m_tbHits;
-            for (unsigned int i = 0; i < m_thc; ++i) {
-                sumNodes += m_threadParams[i].m_nodes;
-                sumHits += m_threadParams[i].m_tbHits;
-            }
-            m_time.adjust(m_score, m_depth);
+            auto totals = aggregateStats();
+            sumNodes = totals.m_nodes;
+            sumHits = totals.m_tbHits;
+            m_time.adjust(m_score, m_depth, bestMoveEffort());
         }
 
-        if (!(m_flags & MODE_SILENT) && m_principalSearcher)
-            printPV(m_position, m_depth, m_selDepth, m_score, m_pv[0], m_pvSize[0], m_best, sumNodes, sumHits, nps);
+        if (!(m_flags & MODE_SILENT) && m_principalSearcher) {
+            if (multiPV > 1) {
+                for (size_t i = 0; i < multiPV; ++i) {
+                    const auto & rm = m_rootMoves[i];
+                    printPV(m_position, rm.m_depth, rm.m_selDepth, rm.m_score, rm.m_pv, rm.m_pvSize, rm.m_mv, sumNodes, sumHits, nps, static_cast<int>(i + 1));
+                }
+            }
+            else
+                printPV(m_position, m_depth, m_stats.selDepth(), m_score, m_pv[0], m_pvSize[0], m_best, sumNodes, sumHits, nps);
+        }
 
         //
         //  Check time limits
@@ -1198,14 +1491,7 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
         if (dt > 1000)
             nps = 1000 * sumNodes / dt;
 
-        //
-        //  Scale the soft limit by best move stability: an unsettled search earns more
-        //  time while a best move stable for many iterations is released early
-        //
-
-        U64 softLimit = static_cast<U64>(m_time.getSoftLimit()) * (130 - 5 * bestMoveStability) / 100;
-
-        if (m_time.getTimeMode() == Time::TimeControl::TimeLimit && dt >= softLimit) {
+        if (m_time.getTimeMode() == Time::TimeControl::TimeLimit && dt >= m_time.getSoftLimit()) {
             m_flags |= TERMINATED_BY_LIMIT;
             break;
         }
@@ -1216,11 +1502,16 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
         }
     }
 
+    stopTimer();
+
     //
-    //  Stop worker threads if necessary
+    //  Stop worker threads if necessary. MultiPV lines come from the root table of the
+    //  principal searcher, so helpers only get a vote on a single line search
     //
 
-    if (m_thc) {
+    if (m_thc && multiPV > 1)
+        stopWorkerThreads();
+    else if (m_thc) {
         stopWorkerThreads();
 
         //
@@ -1288,7 +1579,7 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
         std::map<Move, std::pair<int64_t, Stat>> votes;
 
         if (m_best)
-            votes[m_best] = std::make_pair(voteWeight(m_score, m_depth), Stat{ m_ponder, m_score, m_depth, m_selDepth, m_pvPrev[0], m_pvSizePrev[0] });
+            votes[m_best] = std::make_pair(voteWeight(m_score, m_depth), Stat{ m_ponder, m_score, m_depth, m_stats.selDepth(), m_pvPrev[0], m_pvSizePrev[0] });
 
         for (unsigned int i = 0; i < m_thc; ++i) {
             auto & worker = m_threadParams[i];
@@ -1299,7 +1590,7 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
             auto & vote = votes[worker.m_best];
             vote.first += voteWeight(worker.m_score, worker.m_depth);
 
-            Stat workerStat{ worker.m_ponder, worker.m_score, worker.m_depth, worker.m_selDepth, worker.m_pvPrev[0], worker.m_pvSizePrev[0] };
+            Stat workerStat{ worker.m_ponder, worker.m_score, worker.m_depth, worker.m_stats.selDepth(), worker.m_pvPrev[0], worker.m_pvSizePrev[0] };
 
             if (moreAuthoritative(workerStat, vote.second))
                 vote.second = workerStat;
@@ -1345,12 +1636,12 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
             m_ponder   = best->ponder;
             m_score    = best->score;
             m_depth    = best->depth;
-            m_selDepth = best->selDepth;
+            m_stats.setSelDepth(best->selDepth);
             m_pvSizePrev[0] = best->pvSize;
             memcpy(m_pvPrev[0], best->pv, best->pvSize * sizeof(Move));
         }
 
-        printPV(m_position, m_depth, m_selDepth, m_score, m_pvPrev[0], m_pvSizePrev[0], m_best, sumNodes, sumHits, nps);
+        printPV(m_position, m_depth, m_stats.selDepth(), m_score, m_pvPrev[0], m_pvSizePrev[0], m_best, sumNodes, sumHits, nps);
     }
 
     //
@@ -1361,20 +1652,26 @@ uint64_t Search::startSearch(Time time, int depth, bool ponderSearch, bool bench
     m_ponderHit = false;
 
     if (!(m_flags & MODE_SILENT) && m_principalSearcher) {
-        if (!m_thc)
-            printPV(m_position, m_depth, m_selDepth, m_score, m_pv[0], m_pvSize[0], m_best, sumNodes, sumHits, nps);
+        if (!m_thc && multiPV <= 1)
+            printPV(m_position, m_depth, m_stats.selDepth(), m_score, m_pv[0], m_pvSize[0], m_best, sumNodes, sumHits, nps);
         printBestMove(this, m_position, m_best, m_ponder);
     }
 
-    return m_nodes;
+    return aggregateStats().m_nodes;
 }
 
 void Search::setPonderHit()
 {
-    m_ponderHit = true;
-    m_flags     = MODE_PLAY;
-    m_t0        = GetProcTime();
-    m_time      = m_ponderTime;
+    {
+        std::lock_guard<std::mutex> lk(m_stopMutex);
+
+        m_ponderHit = true;
+        m_flags     = MODE_PLAY;
+        m_t0        = GetProcTime();
+        m_time      = m_ponderTime;
+    }
+
+    m_stopcv.notify_all(); // the time limits start now, and the ponder wait is over
 }
 
 void Search::setSyzygyDepth(int depth)
@@ -1387,6 +1684,39 @@ void Search::setLevel(int level)
     m_level = level;
 }
 
+void Search::setMultiPV(int multiPV)
+{
+    m_multiPV = std::max(multiPV, 1);
+}
+
+void Search::setQSearchHash(size_t kb)
+{
+    m_qHashKb = kb;
+    m_qtable.setSize(kb);
+
+    for (unsigned int i = 0; i < m_thc; ++i)
+        m_threadParams[i].m_qtable.setSize(kb);
+}
+
+void Search::clearQSearchHash()
+{
+    m_qtable.clear();
+
+    for (unsigned int i = 0; i < m_thc; ++i)
+        m_threadParams[i].m_qtable.clear();
+}
+
+void Search::setSearchMoves(const std::vector<Move> & moves)
+{
+    m_searchMovesSize = std::min(moves.size(), sizeof(m_searchMoves) / sizeof(Move));
+    std::copy(moves.begin(), moves.begin() + m_searchMovesSize, m_searchMoves);
+
+    for (unsigned int i = 0; i < m_thc; ++i) {
+        m_threadParams[i].m_searchMovesSize = m_searchMovesSize;
+        std::copy(m_searchMoves, m_searchMoves + m_searchMovesSize, m_threadParams[i].m_searchMoves);
+    }
+}
+
 void Search::setThreadCount(unsigned int threads)
 {
     if (threads == m_thc)
@@ -1398,8 +1728,10 @@ void Search::setThreadCount(unsigned int threads)
     m_threads.reset(new std::thread[threads]);
     m_threadParams.reset(new Search[threads]);
 
-    for (unsigned int i = 0; i < m_thc; ++i)
+    for (unsigned int i = 0; i < m_thc; ++i) {
+        m_threadParams[i].m_qtable.setSize(m_qHashKb);
         m_threads[i] = std::thread(&Search::lazySmpSearcher, &m_threadParams[i]);
+    }
 }
 
 unsigned int Search::getThreadsCount()
@@ -1425,6 +1757,7 @@ void Search::lazySmpSearcher()
 
             startSearch(m_time, m_depth, ponder);
             resetLazySmpWork();
+            m_donecv.notify_all();
         }
     }
 }
@@ -26,11 +26,13 @@
 #include "time.h"
 #include "tt.h"
 
+#include <atomic>
 #include <thread>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <vector>
 
 const int MIN_LEVEL = 0;
 const int MAX_LEVEL = 20;
@@ -52,10 +54,67 @@ const U8 MODE_SILENT  = 0x10;
 
 #define MATED_IN_MAX (MAX_PLY - CHECKMATE_SCORE)
 
+//
+//  Result of the last search of one root move: exact when the move was the best one of
+//  its MultiPV line, -CHECKMATE_SCORE (unknown, below alpha) otherwise. m_nodes is the
+//  effort spent under the move in the current iteration
+//
+
+struct RootMove
+{
+    Move  m_mv;
+    EVAL  m_score;
+    EVAL  m_prevScore;
+    int   m_depth;
+    int   m_selDepth;
+    NODES m_nodes;
+    NODES m_prevNodes;
+    Move  m_pv[MAX_PLY];
+    int   m_pvSize;
+};
+
+//
+//  Counters of one search thread on a cache line of their own. Only the owner writes them,
+//  with a relaxed load and store instead of a locked add; other threads read them relaxed
+//
+
+struct alignas(64) SearchStats
+{
+    std::atomic<NODES> m_nodes{0};
+    std::atomic<NODES> m_qNodes{0};
+    std::atomic<NODES> m_tbHits{0};
+    std::atomic<NODES> m_ttHits{0};
+    std::atomic<NODES> m_cutoffs{0};
+    std::atomic<int>   m_selDepth{0};
+
+    static void bump(std::atomic<NODES> & counter) { counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    void reset();
+    NODES nodes() const { return m_nodes.load(std::memory_order_relaxed); }
+    int selDepth() const { return m_selDepth.load(std::memory_order_relaxed); }
+    void setSelDepth(int selDepth) { m_selDepth.store(selDepth, std::memory_order_relaxed); }
+    void updateSelDepth(int ply) { if (ply > selDepth()) setSelDepth(ply); }
+};
+
+//
+//  Sum of the counters of the principal searcher and all helpers, seldepth is the maximum
+//
+
+struct SearchTotals
+{
+    NODES m_nodes = 0;
+    NODES m_qNodes = 0;
+    NODES m_tbHits = 0;
+    NODES m_ttHits = 0;
+    NODES m_cutoffs = 0;
+    int   m_selDepth = 0;
+};
+
 class Search
 {
     friend class History;
     friend class MoveEval;
+    friend class MovePicker;
     friend class GenWorker;
 
 public:
@@ -79,6 +138,10 @@ public:
     void stopPrincipalSearch();
     void isReady();
     void setLevel(int level);
+    void setMultiPV(int multiPV);
+    void setQSearchHash(size_t kb);
+    void clearQSearchHash();
+    void setSearchMoves(const std::vector<Move> & moves);
     bool setFEN(const std::string& fen);
     bool setInitialPosition();
     bool makeMove(Move mv);
@@ -101,23 +164,42 @@ private:
             return 1;
         return 0;
     }
-    bool ProbeHash(TEntry & hentry, U64 hash);
-    void printPV(const Position& pos, int iter, int selDepth, EVAL score, const Move* pv, int pvSize, Move mv, uint64_t sumNodes, uint64_t sumHits, uint64_t nps);
+    bool ProbeHash(TEntry & hentry, U64 hash, EVAL & staticEval);
+    bool ProbeQHash(TEntry & hentry, U64 hash, EVAL & staticEval);
+    void RecordQHash(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash, EVAL staticEval);
+    void printPV(const Position& pos, int iter, int selDepth, EVAL score, const Move* pv, int pvSize, Move mv, uint64_t sumNodes, uint64_t sumHits, uint64_t nps, int multiPV = 0);
     bool isDraw();
+    void initRootMoves();
+    void sortRootMoves();
+    RootMove * findRootMove(Move mv);
+    void updateRootMove(Move mv, EVAL score, bool pvMove, NODES nodes);
+    double bestMoveEffort() const;
 
-    bool checkLimits();
+    FORCE_INLINE bool checkLimits()
+    {
+        if (m_nodesBudget && m_stats.nodes() >= m_nodesCheck)
+            claimNodes();
+
+        return (m_flags & SEARCH_TERMINATED) || m_smpThreadExit;
+    }
+    void claimNodes();
+    void startTimer();
+    void stopTimer();
+    void timerRoutine();
+    void raiseStop(U8 flags);
+    SearchTotals aggregateStats() const;
     void releaseHelperThreads();
     void waitUntilCompletion();
 
 private:
-    NODES m_nodes;
-    NODES m_tbHits;
-    NODES m_limitCheck;
+    SearchStats m_stats;
+    std::atomic<NODES> m_nodesLeft;     // principal searcher only: the part of the go nodes limit no thread has claimed yet
+    std::atomic<NODES> * m_nodesBudget; // m_nodesLeft of the principal searcher, claimed by every thread, nullptr without a limit
+    NODES m_nodesCheck;                 // own node count up to which this thread has claimed nodes
     U32 m_t0;
-    volatile U8 m_flags;
+    std::atomic<U8> m_flags;
     int m_depth;
     int m_syzygyDepth;
-    int m_selDepth;
     MoveList m_lists[MAX_PLY];
     MoveList m_singularLists[MAX_PLY];  // excluded search runs at the parent's ply
     int m_singularPly = -1;             // every frame at that ply uses the parallel list
@@ -125,6 +207,14 @@ private:
     int m_pvSize[MAX_PLY];
     Move m_pvPrev[MAX_PLY][MAX_PLY];
     int m_pvSizePrev[MAX_PLY];
+    RootMove m_rootMoves[256];
+    size_t m_rootMovesSize;
+    size_t m_pvIdx;                     // MultiPV line being searched, lines above it are excluded at root
+    int m_multiPV;
+    QTable m_qtable;                    // quiescence entries of this thread, empty when qsearch uses the shared table
+    size_t m_qHashKb;
+    Move m_searchMoves[256];            // go searchmoves, the root is restricted to these when not empty
+    size_t m_searchMovesSize;
     Move m_killerMoves[MAX_PLY][2];
     Move m_counterTable[14][64] = {}; // refutation move of the previous [piece][to]
     int16_t m_history[2][64][64];
@@ -149,8 +239,9 @@ private:
     std::unique_ptr<std::thread[]> m_threads;
     std::unique_ptr<Search[]> m_threadParams;
     std::condition_variable m_lazycv;
-    volatile int m_lazyDepth;
-    volatile bool m_smpThreadExit;
+    std::condition_variable m_donecv;   // a helper finished its search, m_lazyDepth is 0
+    std::atomic<int> m_lazyDepth;
+    std::atomic<bool> m_smpThreadExit;
     bool m_lazyPonder;
     static constexpr int m_lmpDepth = 8;
     static constexpr int m_lmpPruningTable[2][9] =
@@ -164,6 +255,11 @@ private:
     static constexpr int m_fmpHistoryLimit[] = { -2000, -4000   };
     static constexpr int m_fpHistoryLimit[]  = { 12000, 6000    };
     bool m_terminateSmp;
+    std::thread m_timer;                // principal searcher only: raises TERMINATED_BY_LIMIT at the hard limit
+    std::mutex m_stopMutex;             // guards changes of m_flags made from outside the search thread
+    std::condition_variable m_stopcv;   // signalled on each of them, waited on by the timer and the ponder wait
+    bool m_timerExit;
+    U32 m_stopTime;                     // when the stop was raised, for the latency report of debug builds
     int m_level;
     bool m_ponderHit;
     EVAL m_score;
@@ -167,8 +167,17 @@ bool Time::evaluate()
     return true;
 }
 
-void Time::adjust(EVAL score, int depth)
+void Time::adjust(EVAL score, int depth, double bestMoveEffort)
 {
+    //
+    //  Scale the soft limit by the share of root nodes spent on the best move: an unsettled
+    //  search that keeps looking at alternatives earns up to 30% more time, a best move that
+    //  takes nearly all of the effort is released up to 20% early
+    //
+
+    auto settled = std::min(std::max((bestMoveEffort - 0.4) / 0.5, 0.0), 1.0);
+    m_effortScale = 1.3 - 0.5 * settled;
+
     //
     //  Ignore shallow depth
     //
@@ -193,11 +202,12 @@ void Time::resetAdjustment()
 {
     m_onPv  = false;
     m_prevScore = DRAW_SCORE;
+    m_effortScale = 1.0;
 }
 
 U32 Time::getSoftLimit()
 {
-    return m_softLimit;
+    return static_cast<U32>(std::min(m_softLimit * m_effortScale, static_cast<double>(m_hardLimit)));
 }
 
 U32 Time::getHardLimit()
@@ -41,7 +41,7 @@ public:
 
 public:
     void onNewGame();
-    void adjust(EVAL score, int depth);
+    void adjust(EVAL score, int depth, double bestMoveEffort);
     void resetAdjustment();
     bool parseTime(const std::vector<std::string> & cmdline, bool whiteSide);
     TimeControl getTimeMode();
@@ -75,6 +75,7 @@ private:
 private:
     bool m_onPv;
     EVAL m_prevScore;
+    double m_effortScale;
     U32  m_movesPlayed;
 };
 
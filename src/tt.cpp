@@ -21,60 +21,95 @@
 #include "utils.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 #include <thread>
 
-#if defined(__linux__) && !defined(__ANDROID__)
-#include <sys/mman.h>
-#endif
+//
+//  a saved table starts with this header, padded to HASH_FILE_OFFSET so the clusters that
+//  follow can be mapped directly
+//
 
-TTable::TTable() : m_hash(nullptr), m_hashSize(0), m_hashMask(0), m_hashAge(0)
+struct HashFileHeader
+{
+    char magic[8];      // "IGELHASH"
+    U32  version;       // layout of this header
+    U32  clusterSize;   // sizeof(TTCluster) of the engine that saved the table
+    U64  clusters;
+    U32  age;
+    U32  entries;       // entries per cluster, which tells the cluster layouts apart
+    U64  network;       // identifies the network the scores were computed with
+    U64  generation;    // the keys are salted with the generation of the table
+    char engine[32];    // name and version of the engine that saved the table
+};
+
+static constexpr char HASH_FILE_MAGIC[8] = { 'I', 'G', 'E', 'L', 'H', 'A', 'S', 'H' };
+static constexpr U32 HASH_FILE_VERSION = 3; // 2: entries carry the static evaluation, 3: generation
+static constexpr size_t HASH_FILE_OFFSET = 4096;
+
+static_assert(sizeof(HashFileHeader) <= HASH_FILE_OFFSET, "hash file header must fit before the clusters");
+
+TTable::TTable() : m_hash(nullptr), m_hashSize(0), m_hashMask(0), m_hashAge(0), m_generation(0), m_salt(0), m_numaPolicy(Numa::Policy::Interleave), m_sharedNetwork(0), m_statsEnabled(false)
 {
 }
 
+TTable::~TTable()
+{
+    finishZeroing();
+}
+
 TTable & TTable::instance()
 {
     static TTable instance;
     return instance;
 }
 
-void TTable::record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0)
+void TTable::record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0, EVAL staticEval)
 {
     assert(m_hash);
     assert(m_hashSize);
 
     size_t index = hash0 & m_hashMask;
     TTCluster & cluster = m_hash[index];
-    auto * replaceEntry = &cluster.entry[0];
+    int replace = 0;
+
+    hash0 ^= m_salt;
 
     //
-    // m_data.age is a 7-bit field, so reduce the generation counter the same way
-    // before comparing; this lets the counter wrap cleanly every 128 generations
+    // the age field is narrower than the generation counter, so reduce the counter the
+    // same way before comparing; this lets it wrap cleanly with the field
     //
 
-    const U8 curAge = static_cast<U8>(m_hashAge & 0x7F);
+    const U8 curAge = static_cast<U8>(m_hashAge & TTCluster::AgeMask);
 
-    for (auto i = 0; i < 4; ++i) {
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
         // empty bucket or a matched hash
-        if (!cluster.entry[i].m_key) {
-            replaceEntry = &cluster.entry[i];
+        if (cluster.empty(i)) {
+            replace = i;
             break;
         }
 
-        if ((cluster.entry[i].m_key ^ cluster.entry[i].m_data.raw) == hash0) {
+        if (cluster.matches(i, hash0)) {
 
             //
             //  a key match from this generation is kept unless the new result is exact or nearly as deep
             //
 
-            if (type != HASH_EXACT && cluster.entry[i].m_data.age == curAge && depth + 4 < cluster.entry[i].m_data.depth)
+            if (type != HASH_EXACT && cluster.age(i) == curAge && depth + 4 < cluster.depth(i)) {
+                if (m_statsEnabled)
+                    bumpStat(&StatsStripe::m_kept);
                 return;
+            }
 
-            replaceEntry = &cluster.entry[i];
+            replace = i;
             break;
         }
 
-        if ((cluster.entry[i].m_data.age == curAge) - (replaceEntry->m_data.age == curAge) - (cluster.entry[i].m_data.depth < replaceEntry->m_data.depth) < 0)
-            replaceEntry = &cluster.entry[i];
+        if ((cluster.age(i) == curAge) - (cluster.age(replace) == curAge) - (cluster.depth(i) < cluster.depth(replace)) < 0)
+            replace = i;
     }
 
     if (score > CHECKMATE_SCORE - 50 && score <= CHECKMATE_SCORE)
@@ -83,10 +118,21 @@ void TTable::record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0)
     if (score < -CHECKMATE_SCORE + 50 && score >= -CHECKMATE_SCORE)
         score -= ply;
 
-    replaceEntry->store(mv, score, depth, type, hash0, curAge);
+    if (m_statsEnabled) {
+        if (cluster.empty(replace))
+            bumpStat(&StatsStripe::m_stores);
+        else if (cluster.matches(replace, hash0))
+            bumpStat(&StatsStripe::m_updates);
+        else if (cluster.age(replace) != curAge)
+            bumpStat(&StatsStripe::m_overwritesByAge);
+        else
+            bumpStat(&StatsStripe::m_overwritesByDepth);
+    }
+
+    cluster.store(replace, mv, score, depth, type, hash0, curAge, staticEval);
 }
 
-bool TTable::retrieve(U64 hash, TEntry & hentry)
+bool TTable::retrieve(U64 hash, TEntry & hentry, EVAL & staticEval)
 {
     assert(m_hash);
     assert(m_hashSize);
@@ -94,27 +140,183 @@ bool TTable::retrieve(U64 hash, TEntry & hentry)
     size_t index = hash & m_hashMask;
     auto pCluster = m_hash + index;
 
-    for (auto i = 0; i < 4; ++i) {
-        hentry = pCluster->entry[i]; // make a copy of entry because a race conditon may occure between 'if' and 'return'
-        if ((hentry.m_key ^ hentry.m_data.raw) == hash)
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        if (pCluster->probe(i, hash ^ m_salt, hentry, staticEval)) {
+            hentry.m_key = hash ^ hentry.m_data.raw;
+
+            if (m_statsEnabled) {
+                bumpStat(&StatsStripe::m_probes);
+                bumpStat(&StatsStripe::m_hits);
+            }
             return true;
+        }
+    }
+
+    if (m_statsEnabled) {
+        bumpStat(&StatsStripe::m_probes);
+
+        bool full = true;
+        for (auto i = 0; i < TTCluster::Entries; ++i)
+            full = full && !pCluster->empty(i);
+
+        if (full)
+            bumpStat(&StatsStripe::m_collisions);
     }
 
     return false;
 }
 
+//
+//  permille of the first thousand clusters' entries written by the current search
+//
+
+int TTable::hashfull() const
+{
+    if (!m_hash)
+        return 0;
+
+    const U8 curAge = static_cast<U8>(m_hashAge & TTCluster::AgeMask);
+    const size_t clusters = std::min<size_t>(1000, m_hashSize);
+    size_t used = 0;
+
+    for (size_t c = 0; c < clusters; ++c) {
+        for (auto i = 0; i < TTCluster::Entries; ++i)
+            used += !m_hash[c].empty(i) && m_hash[c].age(i) == curAge;
+    }
+
+    return static_cast<int>(used * 1000 / (clusters * TTCluster::Entries));
+}
+
+void TTable::bumpStat(std::atomic<U64> StatsStripe::* counter)
+{
+    static std::atomic<unsigned int> nextStripe{0};
+    thread_local unsigned int stripe = nextStripe++ % STATS_STRIPES;
+
+    auto & value = m_statsStripes[stripe].*counter;
+    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+TTable::Stats TTable::stats() const
+{
+    Stats total;
+
+    for (const auto & s : m_statsStripes) {
+        total.m_probes            += s.m_probes.load(std::memory_order_relaxed);
+        total.m_hits              += s.m_hits.load(std::memory_order_relaxed);
+        total.m_collisions        += s.m_collisions.load(std::memory_order_relaxed);
+        total.m_stores            += s.m_stores.load(std::memory_order_relaxed);
+        total.m_updates           += s.m_updates.load(std::memory_order_relaxed);
+        total.m_kept              += s.m_kept.load(std::memory_order_relaxed);
+        total.m_overwritesByAge   += s.m_overwritesByAge.load(std::memory_order_relaxed);
+        total.m_overwritesByDepth += s.m_overwritesByDepth.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void TTable::resetStats()
+{
+    for (auto & s : m_statsStripes) {
+        s.m_probes            = 0;
+        s.m_hits              = 0;
+        s.m_collisions        = 0;
+        s.m_stores            = 0;
+        s.m_updates           = 0;
+        s.m_kept              = 0;
+        s.m_overwritesByAge   = 0;
+        s.m_overwritesByDepth = 0;
+    }
+}
+
+std::string TTable::statsReport() const
+{
+    auto s = stats();
+    auto percent = [](U64 part, U64 whole) { return whole ? part * 100 / whole : 0; };
+
+    std::ostringstream ss;
+    ss << "tt hashfull " << hashfull()
+        << " probes " << s.m_probes
+        << " hits " << s.m_hits << " (" << percent(s.m_hits, s.m_probes) << "%)"
+        << " collisions " << s.m_collisions << " (" << percent(s.m_collisions, s.m_probes) << "%)"
+        << " stores " << s.m_stores
+        << " updates " << s.m_updates
+        << " kept " << s.m_kept
+        << " overwrites age " << s.m_overwritesByAge
+        << " depth " << s.m_overwritesByDepth;
+
+    return ss.str();
+}
+
 bool TTable::clearHash(unsigned int threads)
 {
     if (!m_hash)
         return false;
 
+    //
+    //  other processes keep searching with a shared table, and a new segment is already zeroed
+    //
+
+    if (m_memory.mode() == LargeMemory::Mode::Shared)
+        return true;
+
+    finishZeroing();
+
+    //
+    //  first touch placement needs the pages zeroed by pinned threads right away
+    //
+
+    if (m_numaPolicy == Numa::Policy::FirstTouch && Numa::nodes() > 1) {
+        zeroHash(threads);
+        return true;
+    }
+
+    //
+    //  a new generation salts every key, so the old entries stop matching at once. The memory
+    //  is then reset without holding up the caller: huge pages are handed back to the system,
+    //  a large table of ordinary pages is zeroed in the background while the engine waits for
+    //  a search. The next search joins the zeroing before it starts, so the two never compete
+    //  for the cores and the search never loses entries it has just written
+    //
+
+    m_salt = (++m_generation * 0x9E3779B97F4A7C15ull) & TTCluster::KeyBits;
+
+    if (m_memory.discard())
+        return true;
+
+    if (m_hashSize * sizeof(TTCluster) <= 64 * MB)
+        zeroHash(threads);
+    else
+        m_zeroing = std::thread([this, threads]() { zeroHash(threads); });
+
+    return true;
+}
+
+void TTable::finishZeroing() const
+{
+    if (m_zeroing.joinable())
+        m_zeroing.join();
+}
+
+void TTable::zeroHash(unsigned int threads)
+{
+    //
+    //  first touch places each slice on the node of the thread clearing it, so there must
+    //  be at least one thread per node
+    //
+
+    const int nodes = Numa::nodes();
+    const bool firstTouch = m_numaPolicy == Numa::Policy::FirstTouch && nodes > 1;
+
+    if (firstTouch)
+        threads = std::max(threads, static_cast<unsigned int>(nodes));
+
     //
     //  no optimisations required when dealing with a single thread
     //
 
-    if (threads == 1) {
+    if (threads <= 1) {
         memset(reinterpret_cast<void*>(m_hash), 0, m_hashSize * sizeof(TTCluster));
-        return true;
+        return;
     }
 
     size_t size = m_hashSize * sizeof(TTCluster);
@@ -127,8 +329,11 @@ bool TTable::clearHash(unsigned int threads)
     std::vector<std::thread> workers;
 
     for (unsigned int i = 0; i < threads; i++) {
-        workers.push_back(std::thread([tt, size, i, threads]()
+        workers.push_back(std::thread([tt, size, i, threads, firstTouch, nodes]()
             {
+                if (firstTouch)
+                    Numa::bindThread(static_cast<int>(i * nodes / threads));
+
                 size_t range = size / threads;
                 void* ptr = (unsigned char*)tt + (i * range);
                 memset(ptr, 0, range);
@@ -149,8 +354,6 @@ bool TTable::clearHash(unsigned int threads)
         {
             t.join();
         });
-
-    return true;
 }
 
 bool TTable::setHashSize(double mb, unsigned int threads)
@@ -158,35 +361,253 @@ bool TTable::setHashSize(double mb, unsigned int threads)
     if (!mb)
         return false;
 
-    if (m_hash)
-        free(m_hash);
+    finishZeroing();
 
-    m_hashSize = static_cast<size_t>(static_cast<size_t>(1024 * 1024) * mb / sizeof(TTCluster));
+    //
+    //  the old table stays allocated until its entries have moved to the new one
+    //
+
+    LargeMemory previous;
+    previous.swap(m_memory);
+
+    const TTCluster * previousHash = m_hash;
+    const size_t previousSize = m_hashSize;
+    m_hash = nullptr;
 
     // Round down to the nearest power of 2 so we can use & instead of % in hot paths
-    if (m_hashSize > 1) {
+    auto roundDown = [](size_t clusters) {
         size_t p = 1;
-        while (p * 2 <= m_hashSize) p *= 2;
-        m_hashSize = p;
+        while (p * 2 <= clusters) p *= 2;
+        return p;
+    };
+
+    m_hashSize = roundDown(static_cast<size_t>(static_cast<size_t>(1024 * 1024) * mb / sizeof(TTCluster)));
+
+    //
+    //  a shared segment that already exists keeps the size of the process that created it
+    //
+
+    bool created = true;
+    size_t offset = 0;
+
+    if (!m_sharedName.empty() && attachShared(created)) {
+        offset = HASH_FILE_OFFSET;
+
+        // every process reads the shared entries with unsalted keys
+        m_generation = 0;
+        m_salt = 0;
     }
+    else if (!m_memory.allocate(sizeof(TTCluster) * m_hashSize))
+        return false;
+
     m_hashMask = m_hashSize - 1;
+    m_hash = reinterpret_cast<TTCluster*>(reinterpret_cast<char*>(m_memory.data()) + offset);
+
+    if (created && m_numaPolicy == Numa::Policy::Interleave)
+        Numa::interleave(m_hash, sizeof(TTCluster) * m_hashSize);
+
+    std::cout << "info string Hash " << sizeof(TTCluster) * m_hashSize / MB << " Mb in " << m_memory.modeName() << std::endl;
+
+    if (m_memory.mode() != LargeMemory::Mode::Shared)
+        zeroHash(threads);
 
-#if defined(__linux__) && !defined(__ANDROID__)
-    // on linux systems we align on 2MB boundaries and request Huge Pages
-    // idea comes from Sami Kiminki as used in Ethereal
-    m_hash = reinterpret_cast<TTCluster*>(aligned_alloc(2 * MB, sizeof(TTCluster) * m_hashSize));
-    madvise(m_hash, sizeof(TTCluster) * m_hashSize, MADV_HUGEPAGE);
-#else
-    // otherwise, we simply allocate as usual and make no requests
-    m_hash = reinterpret_cast<TTCluster*>(malloc(sizeof(TTCluster) * m_hashSize));
-#endif
+    //
+    //  a shared segment already holds the entries of every process using it
+    //
+
+    if (previousHash && m_memory.mode() != LargeMemory::Mode::Shared)
+        migrate(previousHash, previousSize, threads);
+
+    //
+    //  on NUMA hosts tell where the pages actually landed
+    //
 
-    clearHash(threads);
+    if (m_hash && Numa::nodes() > 1) {
+        auto placement = Numa::placement(m_hash, sizeof(TTCluster) * m_hashSize);
+        if (!placement.empty())
+            std::cout << "info string Hash placement " << placement << std::endl;
+    }
 
     assert(m_hash);
     return m_hash != nullptr;
 }
 
+//
+//  a shared segment starts with a hash file header written by the process that created it. The
+//  entries of another engine version, network or cluster layout are never read as our own, such
+//  a segment is left to its users and this process falls back to private memory
+//
+
+bool TTable::attachShared(bool & created)
+{
+    if (!m_memory.attach(m_sharedName, HASH_FILE_OFFSET + sizeof(TTCluster) * m_hashSize, created)) {
+        std::cout << "info string unable to attach shared Hash " << m_sharedName << ", using private memory" << std::endl;
+        return false;
+    }
+
+    auto header = reinterpret_cast<HashFileHeader*>(m_memory.data());
+
+    // the version is written last and tells the header is complete
+    auto version = reinterpret_cast<std::atomic<U32>*>(&header->version);
+
+    if (created) {
+        memcpy(header->magic, HASH_FILE_MAGIC, sizeof(header->magic));
+        header->clusterSize = sizeof(TTCluster);
+        header->clusters    = m_hashSize;
+        header->entries     = TTCluster::Entries;
+        header->network     = m_sharedNetwork;
+        strncpy(header->engine, m_sharedEngine.c_str(), sizeof(header->engine) - 1);
+        version->store(HASH_FILE_VERSION, std::memory_order_release);
+        return true;
+    }
+
+    for (int i = 0; i < 100 && !version->load(std::memory_order_acquire); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    const size_t clusters = header->clusters;
+
+    if (version->load(std::memory_order_acquire) != HASH_FILE_VERSION || memcmp(header->magic, HASH_FILE_MAGIC, sizeof(header->magic)) ||
+        header->clusterSize != sizeof(TTCluster) || header->entries != TTCluster::Entries ||
+        strncmp(header->engine, m_sharedEngine.c_str(), sizeof(header->engine) - 1) || header->network != m_sharedNetwork ||
+        !clusters || (clusters & (clusters - 1)) || HASH_FILE_OFFSET + clusters * sizeof(TTCluster) > m_memory.size()) {
+        m_memory.release();
+        std::cout << "info string shared Hash " << m_sharedName << " was created by another engine, network or table layout, using private memory" << std::endl;
+        return false;
+    }
+
+    m_hashSize = clusters;
+    return true;
+}
+
+//
+//  moves the entries of the previous table into the current one. An entry keeps its upper key
+//  bits and the old cluster index gives the lower ones, which together must cover the new index.
+//  Old clusters are split into groups that land in disjoint sets of new clusters, so workers
+//  never write to the same cluster
+//
+
+void TTable::migrate(const TTCluster * from, size_t fromSize, unsigned int threads)
+{
+    if (m_hashMask & ~(TTCluster::KeyBits | (fromSize - 1))) {
+        std::cout << "info string Hash entries not kept, the previous table was too small to recover their keys" << std::endl;
+        return;
+    }
+
+    const size_t groups = std::min(fromSize, m_hashSize);
+    threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, groups)));
+
+    std::atomic<size_t> kept{0};
+    std::vector<std::thread> workers;
+
+    auto worker = [this, from, fromSize, groups, threads, &kept](unsigned int t) {
+        size_t moved = 0;
+
+        for (size_t group = groups * t / threads; group < groups * (t + 1) / threads; ++group) {
+            for (size_t c = group; c < fromSize; c += groups) {
+                for (auto i = 0; i < TTCluster::Entries; ++i) {
+                    if (from[c].empty(i))
+                        continue;
+
+                    TEntry hentry{};
+                    EVAL staticEval;
+                    U64 key = from[c].key(i, c); // salted, the salt leaves the index bits alone
+
+                    if (from[c].probe(i, key, hentry, staticEval))
+                        moved += insert(m_hash[(key ^ m_salt) & m_hashMask], key, hentry, staticEval);
+                }
+            }
+        }
+
+        kept += moved;
+    };
+
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(worker, t);
+
+    worker(0);
+
+    for (auto & w : workers)
+        w.join();
+
+    if (kept)
+        std::cout << "info string Hash kept " << kept << " entries" << std::endl;
+}
+
+//
+//  places a migrated entry the way record does, but a full cluster only gives way to an entry
+//  that is more recent or deeper than the one it would replace
+//
+
+bool TTable::insert(TTCluster & cluster, U64 hash, const TEntry & hentry, EVAL staticEval)
+{
+    const U8 curAge = static_cast<U8>(m_hashAge & TTCluster::AgeMask);
+    int replace = 0;
+
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        if (cluster.empty(i)) {
+            replace = i;
+            break;
+        }
+
+        if ((cluster.age(i) == curAge) - (cluster.age(replace) == curAge) - (cluster.depth(i) < cluster.depth(replace)) < 0)
+            replace = i;
+    }
+
+    if (!cluster.empty(replace)) {
+        int victim   = (cluster.age(replace) == curAge) * 256 + cluster.depth(replace);
+        int incoming = (hentry.m_data.age == curAge) * 256 + hentry.m_data.depth;
+
+        if (victim >= incoming)
+            return false;
+    }
+
+    cluster.store(replace, hentry.m_data.move, hentry.m_data.score, static_cast<I8>(hentry.m_data.depth),
+        static_cast<U8>(hentry.m_data.type), hash, static_cast<U8>(hentry.m_data.age), staticEval);
+    return true;
+}
+
+bool TTable::setNumaPolicy(Numa::Policy policy, unsigned int threads)
+{
+    if (policy == m_numaPolicy)
+        return true;
+
+    m_numaPolicy = policy;
+
+    //
+    //  the placement is decided when the pages are first touched, so the table is allocated again
+    //
+
+    return !m_hash || setHashSize(static_cast<double>(m_hashSize * sizeof(TTCluster)) / MB, threads);
+}
+
+bool TTable::setSharedName(const std::string & name, const std::string & engine, U64 network, unsigned int threads)
+{
+    if (name == m_sharedName && engine == m_sharedEngine && network == m_sharedNetwork)
+        return true;
+
+    m_sharedName = name;
+    m_sharedEngine = engine;
+    m_sharedNetwork = network;
+    return !m_hash || setHashSize(static_cast<double>(m_hashSize * sizeof(TTCluster)) / MB, threads);
+}
+
+//
+//  removes the name of the shared segment, a stale segment left by a crashed process or another
+//  engine goes away once every process has detached from it. The next process to attach creates
+//  a fresh segment
+//
+
+bool TTable::unlinkShared()
+{
+    if (m_sharedName.empty() || !LargeMemory::unlink(m_sharedName)) {
+        std::cout << "info string no shared Hash to remove" << std::endl;
+        return false;
+    }
+
+    std::cout << "info string shared Hash " << m_sharedName << " removed" << std::endl;
+    return true;
+}
+
 bool TTable::increaseAge()
 {
     ++m_hashAge;
@@ -198,6 +619,181 @@ void TTable::clearAge()
     m_hashAge = 0;
 }
 
+bool TTable::save(const std::string & path, const std::string & engine, U64 network) const
+{
+    if (!m_hash)
+        return false;
+
+    finishZeroing();
+
+    char block[HASH_FILE_OFFSET] = {};
+    auto header = reinterpret_cast<HashFileHeader*>(block);
+
+    memcpy(header->magic, HASH_FILE_MAGIC, sizeof(header->magic));
+    header->version     = HASH_FILE_VERSION;
+    header->clusterSize = sizeof(TTCluster);
+    header->clusters    = m_hashSize;
+    header->age         = m_hashAge;
+    header->entries     = TTCluster::Entries;
+    header->network     = network;
+    header->generation  = m_generation;
+    strncpy(header->engine, engine.c_str(), sizeof(header->engine) - 1);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(block, sizeof(block));
+    file.write(reinterpret_cast<const char*>(m_hash), m_hashSize * sizeof(TTCluster));
+
+    if (!file) {
+        std::cout << "info string unable to save hash to " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "info string Hash " << m_hashSize * sizeof(TTCluster) / MB << " Mb saved to " << path << std::endl;
+    return true;
+}
+
+bool TTable::load(const std::string & path, const std::string & engine, U64 network)
+{
+    //
+    //  the file would replace the shared segment with a private mapping and silently leave the
+    //  other processes, so a shared table is never loaded over
+    //
+
+    if (m_memory.mode() == LargeMemory::Mode::Shared) {
+        std::cout << "info string " << path << " not loaded, Hash is shared as " << m_sharedName << ", clear HashShared to load it" << std::endl;
+        return false;
+    }
+
+    finishZeroing();
+
+    char block[HASH_FILE_OFFSET] = {};
+    auto header = reinterpret_cast<const HashFileHeader*>(block);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    auto fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    if (!file || !file.read(block, sizeof(block)) || memcmp(header->magic, HASH_FILE_MAGIC, sizeof(header->magic))) {
+        std::cout << "info string " << path << " is not a hash file" << std::endl;
+        return false;
+    }
+
+    //
+    //  scores from another engine version or network, or a table of another layout, are not reused
+    //
+
+    if (header->version != HASH_FILE_VERSION || header->clusterSize != sizeof(TTCluster) || header->entries != TTCluster::Entries ||
+        strncmp(header->engine, engine.c_str(), sizeof(header->engine) - 1) || header->network != network) {
+        std::cout << "info string " << path << " was saved by another engine or network" << std::endl;
+        return false;
+    }
+
+    size_t bytes = header->clusters * sizeof(TTCluster);
+
+    if (fileSize != HASH_FILE_OFFSET + bytes) {
+        std::cout << "info string " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    if (header->clusters != m_hashSize) {
+        std::cout << "info string " << path << " holds " << bytes / MB << " Mb, set Hash to this size before loading it" << std::endl;
+        return false;
+    }
+
+    //
+    //  the file is mapped as the table itself, so only the pages the search touches are read.
+    //  Without mmap the clusters are read into the table already allocated
+    //
+
+    if (m_memory.map(path, HASH_FILE_OFFSET, bytes))
+        m_hash = reinterpret_cast<TTCluster*>(m_memory.data());
+    else if (!file.read(reinterpret_cast<char*>(m_hash), bytes)) {
+        clearHash(1);
+        std::cout << "info string unable to read hash from " << path << std::endl;
+        return false;
+    }
+
+    m_hashAge = header->age;
+    m_generation = header->generation;
+    m_salt = (m_generation * 0x9E3779B97F4A7C15ull) & TTCluster::KeyBits;
+
+    std::cout << "info string Hash " << bytes / MB << " Mb loaded from " << path << " in " << m_memory.modeName() << std::endl;
+    return true;
+}
+
+void QTable::setSize(size_t kb)
+{
+    size_t clusters = 0;
+
+    if (kb) {
+        clusters = 1;
+        while (clusters * 2 * sizeof(QCluster) <= kb * 1024)
+            clusters *= 2;
+    }
+
+    std::vector<QCluster>(clusters).swap(m_hash);
+    m_hashMask = clusters ? clusters - 1 : 0;
+}
+
+void QTable::clear()
+{
+    if (!m_hash.empty())
+        memset(reinterpret_cast<void*>(m_hash.data()), 0, m_hash.size() * sizeof(QCluster));
+}
+
+void QTable::record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0, EVAL staticEval)
+{
+    assert(!m_hash.empty());
+
+    auto & cluster = m_hash[hash0 & m_hashMask];
+    int replace = -1;
+
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        if (cluster.empty(i) || cluster.matches(i, hash0)) {
+            replace = i;
+            break;
+        }
+    }
+
+    if (replace < 0) {
+        const int first = static_cast<int>((hash0 >> 32) % TTCluster::Entries);
+        replace = first;
+
+        for (auto k = 1; k < TTCluster::Entries; ++k) {
+            int i = (first + k) % TTCluster::Entries;
+            if (cluster.depth(i) < cluster.depth(replace))
+                replace = i;
+        }
+    }
+
+    if (score > CHECKMATE_SCORE - 50 && score <= CHECKMATE_SCORE)
+        score += ply;
+
+    if (score < -CHECKMATE_SCORE + 50 && score >= -CHECKMATE_SCORE)
+        score -= ply;
+
+    cluster.store(replace, mv, score, depth, type, hash0, 0, staticEval);
+}
+
+bool QTable::retrieve(U64 hash, TEntry & hentry, EVAL & staticEval) const
+{
+    assert(!m_hash.empty());
+
+    const auto & cluster = m_hash[hash & m_hashMask];
+
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        if (cluster.probe(i, hash, hentry, staticEval))
+            return true;
+    }
+
+    return false;
+}
+
+void QTable::prefetchEntry(U64 hash)
+{
+    prefetch(&m_hash[hash & m_hashMask]);
+}
+
 void TTable::prefetchEntry(U64 hash)
 {
     assert(hash);
@@ -20,12 +20,24 @@
 #ifndef TTABLE_H
 #define TTABLE_H
 
+#include "largemem.h"
+#include "numa.h"
 #include "position.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
 const U8 HASH_ALPHA = 0;
 const U8 HASH_EXACT = 1;
 const U8 HASH_BETA  = 2;
 
+// static evaluation of an entry that has none, e.g. when the side to move was in check
+const EVAL TT_NO_EVAL = -32768;
+
 class TEntry
 {
 public:
@@ -46,7 +58,7 @@ public:
 
 public:
 
-    void store(Move mv, EVAL score, I8 depth, U8 type, U64 hash0, U8 age)
+    void store(Move mv, EVAL score, I8 depth, U8 type, U64 hash0, U8 age, EVAL staticEval = TT_NO_EVAL)
     {
         assert(type >= 0 && type <= 2);
         assert(age >= 0 && age <= 255);
@@ -60,7 +72,13 @@ public:
         m_data.depth = depth;
         m_data.score = score;
 
-        m_key = hash0 ^ m_data.raw;
+        //
+        //  the low 16 bits of the key word carry the static evaluation. They are covered by the
+        //  cluster index, and a mix of the evaluation keeps a torn entry from matching
+        //
+
+        U64 eval = static_cast<U16>(std::max(std::min(staticEval, 32767), -32768));
+        m_key = ((hash0 ^ m_data.raw ^ (eval * 0x9E3779B97F4A7C15ull)) & ~0xFFFFull) | eval;
 
         // when debugging a multi cpu configuration these may give you a trouble:
         assert(age == m_data.age);
@@ -70,40 +88,247 @@ public:
         assert(score == m_data.score);
     }
 
+    // the key bits the entry keeps, the low 16 come from the cluster index
+    U64 keyBits() const
+    {
+        U64 eval = m_key & 0xFFFF;
+        return (m_key ^ m_data.raw ^ (eval * 0x9E3779B97F4A7C15ull)) & ~0xFFFFull;
+    }
+
+    bool matches(U64 hash) const { return keyBits() == (hash & ~0xFFFFull); }
+
+    EVAL staticEval() const { return static_cast<I16>(m_key & 0xFFFF); }
+
 public:
     HashEntry m_data;
     U64  m_key;
 };
 static_assert(sizeof(TEntry) == 16, "TEntry must be 16 bytes");
 
+#if !defined(TT_COMPACT)
+
 struct TTCluster {
-    TEntry entry[4];
+    static constexpr int Entries = 4;
+    static constexpr U8 AgeMask  = 0x7F;
+    static constexpr U64 KeyBits = ~0xFFFFull;
+
+    bool empty(int i) const { return !entry[i].m_key; }
+    bool matches(int i, U64 hash) const { return entry[i].matches(hash); }
+    U8 age(int i) const { return entry[i].m_data.age; }
+    I8 depth(int i) const { return entry[i].m_data.depth; }
+    U64 key(int i, size_t index) const { return entry[i].keyBits() | (index & ~KeyBits); }
+
+    bool probe(int i, U64 hash, TEntry & hentry, EVAL & staticEval) const
+    {
+        hentry = entry[i]; // make a copy of entry because a race conditon may occure between 'if' and 'return'
+
+        if (!hentry.matches(hash))
+            return false;
+
+        staticEval   = hentry.staticEval();
+        hentry.m_key = hash ^ hentry.m_data.raw;
+        return true;
+    }
+
+    void store(int i, Move mv, EVAL score, I8 depth, U8 type, U64 hash0, U8 age, EVAL staticEval)
+    {
+        entry[i].store(mv, score, depth, type, hash0, age, staticEval);
+    }
+
+    TEntry entry[Entries];
+};
+
+#else
+
+//
+//  Compact cluster, selected with -DTT_COMPACT: seven 9 byte entries per cache line instead of
+//  four 16 byte ones. An entry keeps the fields of HashEntry in 56 bits, with the age cut to
+//  4 bits, and a 16 bit check made of the top key bits xored with a fold of the data, so a torn
+//  entry is still rejected. The cluster index supplies the low key bits. There is no room left
+//  for the static evaluation, so entries never carry one
+//
+
+struct TTCluster {
+    static constexpr int Entries = 7;
+    static constexpr U8 AgeMask  = 0x0F;
+    static constexpr U64 KeyBits = 0xFFFF000000000000ull;
+
+    static U64 pack(Move mv, EVAL score, I8 depth, U8 type, U8 age)
+    {
+        return (static_cast<U64>(mv) & 0x1FFFFFF) | (static_cast<U64>(age & AgeMask) << 25) | (static_cast<U64>(type & 3) << 29)
+            | (static_cast<U64>(score & 0x1FFFF) << 31) | (static_cast<U64>(static_cast<U8>(depth)) << 48);
+    }
+
+    static U16 fold(U64 hash, U64 data)
+    {
+        return static_cast<U16>((hash >> 48) ^ data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48));
+    }
+
+    U64 load(int i) const
+    {
+        U64 v = 0;
+        memcpy(&v, data + i * 7, 7);
+        return v;
+    }
+
+    bool empty(int i) const { return !load(i); }
+    bool matches(int i, U64 hash) const { U64 v = load(i); return v && check[i] == fold(hash, v); }
+    U8 age(int i) const { return static_cast<U8>((load(i) >> 25) & AgeMask); }
+    I8 depth(int i) const { return static_cast<I8>(load(i) >> 48); }
+    U64 key(int i, size_t index) const { return (static_cast<U64>(static_cast<U16>(check[i] ^ fold(0, load(i)))) << 48) | (index & ~KeyBits); }
+
+    bool probe(int i, U64 hash, TEntry & hentry, EVAL & staticEval) const
+    {
+        U16 c = check[i];
+        U64 v = load(i);
+
+        if (!v || c != fold(hash, v))
+            return false;
+
+        hentry.m_data.move  = static_cast<U32>(v & 0x1FFFFFF);
+        hentry.m_data.age   = static_cast<U32>((v >> 25) & AgeMask);
+        hentry.m_data.type  = static_cast<U32>((v >> 29) & 3);
+        hentry.m_data.score = static_cast<I32>(static_cast<I64>(v << 16) >> 47);
+        hentry.m_data.depth = static_cast<I8>(v >> 48);
+        hentry.m_key        = hash ^ hentry.m_data.raw;
+        staticEval          = TT_NO_EVAL;
+        return true;
+    }
+
+    void store(int i, Move mv, EVAL score, I8 depth, U8 type, U64 hash0, U8 age, EVAL /*staticEval*/)
+    {
+        assert(score >= -65536 && score < 65536);
+
+        U64 v = pack(mv, score, depth, type, age);
+        check[i] = fold(hash0, v);
+        memcpy(data + i * 7, &v, 7);
+    }
+
+    U16 check[Entries];
+    U8  data[Entries * 7];
+    U8  padding;
 };
 
+#endif
+
 static_assert(sizeof(TTCluster) == 64, "TTCluster must be 64 bytes");
 
 class TTable
 {
+public:
+    //
+    //  counters collected while statistics are enabled, summed over all threads
+    //
+
+    struct Stats
+    {
+        U64 m_probes            = 0;
+        U64 m_hits              = 0;
+        U64 m_collisions        = 0; // misses in a cluster filled with other positions
+        U64 m_stores            = 0; // results written to an empty slot
+        U64 m_updates           = 0; // results written over the same position
+        U64 m_kept              = 0; // results dropped for a deeper entry of the same position
+        U64 m_overwritesByAge   = 0; // other positions from an older search replaced
+        U64 m_overwritesByDepth = 0; // shallowest position of the current search replaced
+    };
+
 public:
     TTable();
+    ~TTable();
     static TTable & instance();
 
 public:
     bool setHashSize(double mb, unsigned int threads);
+    bool setNumaPolicy(Numa::Policy policy, unsigned int threads);
+    bool setSharedName(const std::string & name, const std::string & engine, U64 network, unsigned int threads);
+    bool unlinkShared();
     bool clearHash(unsigned int threads);
-    void record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0);
-    bool retrieve(U64 hash, TEntry & hentry);
+    void finishZeroing() const;
+    void record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0, EVAL staticEval = TT_NO_EVAL);
+    bool retrieve(U64 hash, TEntry & hentry, EVAL & staticEval);
+    bool retrieve(U64 hash, TEntry & hentry) { EVAL staticEval; return retrieve(hash, hentry, staticEval); }
     bool increaseAge();
     void clearAge();
     void prefetchEntry(U64 hash);
+    bool save(const std::string & path, const std::string & engine, U64 network) const;
+    bool load(const std::string & path, const std::string & engine, U64 network);
+    int hashfull() const;
+    void enableStats(bool enable) { m_statsEnabled = enable; }
+    bool statsEnabled() const { return m_statsEnabled; }
+    Stats stats() const;
+    void resetStats();
+    std::string statsReport() const;
 
 private:
+    //
+    //  each thread counts into its own stripe so the counters do not bounce between cores
+    //
+
+    struct alignas(64) StatsStripe
+    {
+        std::atomic<U64> m_probes{0};
+        std::atomic<U64> m_hits{0};
+        std::atomic<U64> m_collisions{0};
+        std::atomic<U64> m_stores{0};
+        std::atomic<U64> m_updates{0};
+        std::atomic<U64> m_kept{0};
+        std::atomic<U64> m_overwritesByAge{0};
+        std::atomic<U64> m_overwritesByDepth{0};
+    };
+
+    static constexpr int STATS_STRIPES = 64;
+    void bumpStat(std::atomic<U64> StatsStripe::* counter);
+    void zeroHash(unsigned int threads);
+    bool attachShared(bool & created);
+    void migrate(const TTCluster * from, size_t fromSize, unsigned int threads);
+    bool insert(TTCluster & cluster, U64 hash, const TEntry & hentry, EVAL staticEval);
+
+private:
+    LargeMemory m_memory;
     mutable TTCluster * m_hash;
     mutable size_t m_hashSize;
     mutable size_t m_hashMask;
     mutable unsigned int m_hashAge;
+    U64 m_generation;  // bumped by every clear
+    U64 m_salt;        // mixed into the keys of the current generation, so older entries never match
+    mutable std::thread m_zeroing;
+    Numa::Policy m_numaPolicy;
+    std::string m_sharedName;
+    std::string m_sharedEngine;  // stamped into the header of a shared segment, with the network
+    U64 m_sharedNetwork;
+    bool m_statsEnabled;
+    StatsStripe m_statsStripes[STATS_STRIPES];
     static constexpr uint64_t MB = 1ull << 20;
 
 };
 
+//
+//  Small table for quiescence entries, owned by a single search thread and sized to stay in
+//  its cache, so the shallow qsearch results no longer evict deeper entries from the shared
+//  table. Entries carry no age: the shallowest one of a cluster is replaced, and ties are
+//  broken by the key so the slots are used evenly
+//
+
+class QTable
+{
+    struct alignas(64) QCluster : TTCluster {};
+
+public:
+    QTable() : m_hashMask(0) {}
+    QTable(const QTable&) = delete;
+    QTable& operator=(const QTable&) = delete;
+
+public:
+    void setSize(size_t kb);
+    void clear();
+    bool enabled() const { return !m_hash.empty(); }
+    void record(Move mv, EVAL score, I8 depth, int ply, U8 type, U64 hash0, EVAL staticEval);
+    bool retrieve(U64 hash, TEntry & hentry, EVAL & staticEval) const;
+    void prefetchEntry(U64 hash);
+
+private:
+    std::vector<QCluster> m_hash;
+    size_t m_hashMask;
+};
+
 #endif
@@ -20,14 +20,17 @@
 #include "uci.h"
 #include "time.h"
 #include "notation.h"
+#include "cpu.h"
 #include "nnue.h"
 #include "utils.h"
 #include "gen.h"
+#include "perft.h"
 
 #if defined (SYZYGY_SUPPORT)
 #include "fathom/tbprobe.h"
 #endif
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -37,6 +40,13 @@ const std::string PROGRAM_NAME = "Igel HCE";
 #else
 const std::string PROGRAM_NAME = "Igel";
 #endif
+#if defined(USE_DISPATCH)
+//
+//  a dispatching build names the instruction set it selected on this machine
+//
+
+const std::string ARCHITECTURE = std::string(" 64 ") + (Cpu::fastPext() ? "BMI2 " : "POPCNT ") + Cpu::isaName();
+#else
 const std::string ARCHITECTURE = " 64 "
 
 #if _BTYPE==0
@@ -57,6 +67,7 @@ const std::string ARCHITECTURE = " 64 "
 #endif
 #endif
 ;
+#endif
 
 /*
 #if defined(ENV64BIT)
@@ -87,6 +98,13 @@ const int DEFAULT_THREADS = 1;
 const int MIN_THREADS     = 1;
 const int MAX_THREADS     = 1024;
 
+const int DEFAULT_MULTIPV = 1;
+const int MIN_MULTIPV     = 1;
+const int MAX_MULTIPV     = 256;
+
+const int DEFAULT_QSEARCH_HASH = 0;     // Kb per thread, 0 keeps quiescence entries in the shared table
+const int MAX_QSEARCH_HASH     = 65536;
+
 int Uci::handleCommands()
 {
     std::cout << PROGRAM_NAME << " " << VERSION << ARCHITECTURE << " by V. Shcherbyna (Igel author 2018-2025), V. Medvedev (GreKo author 2002-2018)" << std::endl;
@@ -96,6 +114,10 @@ int Uci::handleCommands()
         return 1;
     }
 
+#if !defined(PURE_HCE)
+    std::cout << "info string NNUE weights in " << Evaluator::weightsPages() << std::endl;
+#endif
+
     // humanoids often forget to issue a 'ucinewgame' command, so let's rectify this:
     onUciNewGame();
 
@@ -125,6 +147,14 @@ int Uci::handleCommands()
             onEval();
         else if (startsWith(cmd, "gen"))
             onGenerate(split(cmd));
+        else if (startsWith(cmd, "perft") || startsWith(cmd, "divide"))
+            onPerft(split(cmd));
+        else if (startsWith(cmd, "tt"))
+            onTT(split(cmd));
+        else if (startsWith(cmd, "savehash"))
+            onSaveHash(split(cmd));
+        else if (startsWith(cmd, "loadhash"))
+            onLoadHash(split(cmd));
         else {
             std::cout << "Unknown command. Good bye." << std::endl;
             exit(0); // important to exit when stdin is gone to prevent issues in OpenBench
@@ -149,6 +179,15 @@ void Uci::onUci()
         " min "     << MIN_THREADS                  <<
         " max "     << MAX_THREADS                  << std::endl;
 
+    std::cout << "option name NumaPolicy type combo default Interleave var Interleave var FirstTouch var None" << std::endl;
+    std::cout << "option name HashFile type string default <empty>" << std::endl;
+    std::cout << "option name HashShared type string default <empty>" << std::endl;
+
+    std::cout << "option name QSearchHash type spin"    <<
+        " default " << DEFAULT_QSEARCH_HASH             <<
+        " min "     << 0                                <<
+        " max "     << MAX_QSEARCH_HASH                 << std::endl;
+
 #if defined (SYZYGY_SUPPORT)
     std::cout << "option name SyzygyPath type string default <empty>" << std::endl;
 
@@ -158,6 +197,11 @@ void Uci::onUci()
         " max "         << MAX_PLY  << std::endl;
 #endif
 
+    std::cout << "option name MultiPV type spin"    <<
+        " default " << DEFAULT_MULTIPV              <<
+        " min "     << MIN_MULTIPV                  <<
+        " max "     << MAX_MULTIPV                  << std::endl;
+
     std::cout << "option name Ponder type check" <<
         " default false" << std::endl;
 
@@ -178,6 +222,7 @@ void Uci::onUciNewGame()
     TTable::instance().clearHash(m_searcher.getThreadsCount());
     TTable::instance().clearAge();
 
+    m_searcher.clearQSearchHash();
     m_searcher.clearHistory();
     m_searcher.clearKillers();
     m_searcher.clearStacks();
@@ -196,6 +241,24 @@ void Uci::onGo(commandParams params)
 
     assert(params[0] == "go");
 
+    //
+    //  searchmoves takes every following token that is a move, an empty set searches all moves
+    //
+
+    std::vector<Move> searchMoves;
+    auto it = std::find(params.begin(), params.end(), "searchmoves");
+
+    if (it != params.end()) {
+        for (++it; it != params.end(); ++it) {
+            auto mv = StrToMove(*it, m_searcher.m_position);
+            if (!mv)
+                break;
+            searchMoves.push_back(mv);
+        }
+    }
+
+    m_searcher.setSearchMoves(searchMoves);
+
     TTable::instance().increaseAge();
     m_searcher.startPrincipalSearch(time, params[1] == "ponder");
 }
@@ -253,6 +316,7 @@ int Uci::onBench(const char * depth, const char * evalFile)
     onUciNewGame();
 
     m_searcher.m_principalSearcher = true;
+    m_searcher.setSearchMoves({});
 
     uint64_t sumNodes = 0;
     auto start = GetProcTime();
@@ -280,6 +344,102 @@ int Uci::onBench(const char * depth, const char * evalFile)
     return 0; // ci pipelines expect retval 0 for success
 }
 
+//
+//  perft <depth> [threads] [hash in Mb], also available as divide and as ./igel perft
+//
+
+int Uci::onPerft(commandParams params)
+{
+    int depth = 0;
+    unsigned int threads = m_searcher.getThreadsCount();
+    size_t hashMb = 0;
+
+    try {
+        if (params.size() > 1)
+            depth = std::stoi(params[1]);
+        if (params.size() > 2)
+            threads = static_cast<unsigned int>(std::stoul(params[2]));
+        if (params.size() > 3)
+            hashMb = static_cast<size_t>(std::stoul(params[3]));
+    }
+    catch (...) {
+        depth = 0;
+    }
+
+    if (depth < 1 || threads < MIN_THREADS || threads > MAX_THREADS || hashMb > MAX_HASH_SIZE) {
+        std::cout << "Fatal error: invalid parameters for perft command" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<Perft> perft(new Perft(threads, hashMb));
+    perft->run(m_searcher.m_position, depth);
+
+    return 0;
+}
+
+//
+//  tt stats [on|off|reset], prints the hash table statistics or switches their collection.
+//  tt unlink removes the HashShared segment, see README
+//
+
+void Uci::onTT(commandParams params)
+{
+    auto & tt = TTable::instance();
+
+    if (params.size() == 2 && params[1] == "unlink") {
+        tt.unlinkShared();
+        return;
+    }
+
+    if (params.size() < 2 || params[1] != "stats") {
+        std::cout << "Fatal error: invalid parameters for tt command" << std::endl;
+        return;
+    }
+
+    if (params.size() > 2) {
+        if (params[2] == "on")
+            tt.enableStats(true);
+        else if (params[2] == "off")
+            tt.enableStats(false);
+        else if (params[2] == "reset")
+            tt.resetStats();
+        else {
+            std::cout << "Fatal error: invalid parameters for tt command" << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "info string " << tt.statsReport() << (tt.statsEnabled() ? "" : ", collection is off, enable it with tt stats on") << std::endl;
+}
+
+//
+//  savehash [file] and loadhash [file], the file defaults to the HashFile option
+//
+
+void Uci::onSaveHash(commandParams params)
+{
+    auto path = params.size() > 1 ? params[1] : m_hashFile;
+
+    if (path.empty()) {
+        std::cout << "info string set HashFile or pass a file to savehash" << std::endl;
+        return;
+    }
+
+    TTable::instance().save(path, PROGRAM_NAME + " " + VERSION, Evaluator::networkId());
+}
+
+void Uci::onLoadHash(commandParams params)
+{
+    auto path = params.size() > 1 ? params[1] : m_hashFile;
+
+    if (path.empty()) {
+        std::cout << "info string set HashFile or pass a file to loadhash" << std::endl;
+        return;
+    }
+
+    TTable::instance().load(path, PROGRAM_NAME + " " + VERSION, Evaluator::networkId());
+}
+
 void Uci::onPosition(commandParams params)
 {
     if (params.size() < 2) {
@@ -353,6 +513,49 @@ void Uci::onSetOption(commandParams params)
         m_searcher.setThreadCount(threads - 1);
         onUciNewGame(); // reset internal state of each thread
     }
+    else if (name == "NumaPolicy") {
+        Numa::Policy policy;
+
+        if (value == "Interleave")
+            policy = Numa::Policy::Interleave;
+        else if (value == "FirstTouch")
+            policy = Numa::Policy::FirstTouch;
+        else if (value == "None")
+            policy = Numa::Policy::None;
+        else {
+            std::cout << "Unable set NumaPolicy value. Make sure it is Interleave, FirstTouch or None" << std::endl;
+            return;
+        }
+
+        if (!TTable::instance().setNumaPolicy(policy, m_searcher.getThreadsCount())) {
+            std::cout << "Fatal error: unable to allocate memory for transposition table" << std::endl;
+            exit(1);
+        }
+    }
+    else if (name == "HashFile")
+        m_hashFile = value == "<empty>" ? "" : value;
+    else if (name == "HashShared") {
+        if (!TTable::instance().setSharedName(value == "<empty>" ? "" : value, PROGRAM_NAME + " " + VERSION, Evaluator::networkId(), m_searcher.getThreadsCount())) {
+            std::cout << "Fatal error: unable to allocate memory for transposition table" << std::endl;
+            exit(1);
+        }
+    }
+    else if (name == "QSearchHash") {
+        auto kb = atoi(value.c_str());
+
+        if (kb > MAX_QSEARCH_HASH || kb < 0)
+            std::cout << "Unable set QSearchHash value. Make sure number is correct" << std::endl;
+        else
+            m_searcher.setQSearchHash(kb);
+    }
+    else if (name == "MultiPV") {
+        auto multiPV = atoi(value.c_str());
+
+        if (multiPV > MAX_MULTIPV || multiPV < MIN_MULTIPV)
+            std::cout << "Unable set MultiPV value. Make sure number is correct" << std::endl;
+        else
+            m_searcher.setMultiPV(multiPV);
+    }
     else if (name == "Skill") {
         auto level = atoi(value.c_str());
 
@@ -386,6 +589,7 @@ void Uci::onNewGame()
     TTable::instance().clearHash(m_searcher.getThreadsCount());
     TTable::instance().clearAge();
 
+    m_searcher.clearQSearchHash();
     m_searcher.clearHistory();
     m_searcher.clearKillers();
 }
@@ -55,6 +55,7 @@ public:
 public:
     int handleCommands();
     int onBench(const char* depth, const char* evalFile);
+    int onPerft(commandParams params);
     static commandParams split(const std::string & s, const std::string & sep = " ");
 
 private:
@@ -70,9 +71,13 @@ private:
     void onEval();
     bool startsWith(const std::string & str, const std::string & ptrn);
     void onGenerate(commandParams params);
+    void onTT(commandParams params);
+    void onSaveHash(commandParams params);
+    void onLoadHash(commandParams params);
 
 private:
     Search & m_searcher;
+    std::string m_hashFile;
 };
 
 #endif // UCI_H
@@ -21,6 +21,7 @@
 #include "../moves.h"
 #include "../nnue.h"
 #include <gtest/gtest.h>
+#include <cstdio>
 
 namespace unit
 {
@@ -59,6 +60,201 @@ TEST(TranspositionTableEntryTest, Positive)
     }
 }
 
+TEST(TranspositionTableClearTest, Positive)
+{
+    EXPECT_EQ(true, TTable::instance().setHashSize(2, 1));
+
+    for (auto j = 1; j < 16384; ++j)
+        TTable::instance().record(j, j, 3, 0, 1, j);
+
+    EXPECT_EQ(true, TTable::instance().clearHash(1));
+
+    for (auto j = 1; j < 16384; ++j) {
+        TEntry hentry{};
+        EXPECT_EQ(false, TTable::instance().retrieve(j, hentry));
+    }
+
+    // the entries of the new generation are found again
+    for (auto j = 1; j < 16384; ++j)
+        TTable::instance().record(j, j + 1, 3, 0, 1, j);
+
+    for (auto j = 1; j < 16384; ++j) {
+        TEntry hentry{};
+        EXPECT_EQ(true, TTable::instance().retrieve(j, hentry));
+        EXPECT_EQ(j, hentry.m_key ^ hentry.m_data.raw);
+        EXPECT_EQ(j + 1, hentry.m_data.score);
+    }
+}
+
+TEST(TranspositionTableClusterTest, Positive)
+{
+    TTCluster cluster{};
+    const U64 hash = 0xfedcba9876543210ull;
+
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        EXPECT_EQ(true, cluster.empty(i));
+        cluster.store(i, 33554431 - i, -CHECKMATE_SCORE - 40 + i, static_cast<I8>(-5 + i), static_cast<U8>(i % 3), hash + i, static_cast<U8>(i), 100 * i - 300);
+    }
+
+    for (auto i = 0; i < TTCluster::Entries; ++i) {
+        TEntry hentry{};
+        EVAL staticEval = 0;
+        EXPECT_EQ(false, cluster.probe(i, (hash + i) ^ (1ull << 60), hentry, staticEval)); // the compact layout only checks the top key bits
+        EXPECT_EQ(true, cluster.probe(i, hash + i, hentry, staticEval));
+#if defined(TT_COMPACT)
+        EXPECT_EQ(TT_NO_EVAL, staticEval);
+#else
+        EXPECT_EQ(100 * i - 300, staticEval);
+#endif
+        EXPECT_EQ(33554431 - i, hentry.m_data.move);
+        EXPECT_EQ(-CHECKMATE_SCORE - 40 + i, hentry.m_data.score);
+        EXPECT_EQ(-5 + i, hentry.m_data.depth);
+        EXPECT_EQ(i % 3, hentry.m_data.type);
+        EXPECT_EQ(i, hentry.m_data.age);
+        EXPECT_EQ(hash + i, hentry.m_key ^ hentry.m_data.raw);
+    }
+}
+
+TEST(TranspositionTableStatsTest, Positive)
+{
+    auto & tt = TTable::instance();
+
+    EXPECT_EQ(true, tt.setHashSize(1, 1));
+    EXPECT_EQ(true, tt.clearHash(1));
+    EXPECT_EQ(0, tt.hashfull());
+
+    tt.resetStats();
+    tt.enableStats(true);
+
+    // 1 Mb holds 16384 clusters, fill every slot of each
+    for (auto j = 1; j <= 16384 * TTCluster::Entries; ++j)
+        tt.record(j, j % 1000, 3, 0, HASH_EXACT, (static_cast<U64>(j) << 40) | (j & 16383));
+
+    EXPECT_EQ(1000, tt.hashfull());
+
+    TEntry hentry{};
+    EXPECT_EQ(true, tt.retrieve((1ull << 40) | 1, hentry));
+    EXPECT_EQ(false, tt.retrieve((999999ull << 40) | 1, hentry));
+
+    auto stats = tt.stats();
+    tt.enableStats(false);
+
+    EXPECT_EQ(2u, stats.m_probes);
+    EXPECT_EQ(1u, stats.m_hits);
+    EXPECT_EQ(1u, stats.m_collisions);
+    EXPECT_EQ(static_cast<U64>(16384 * TTCluster::Entries), stats.m_stores);
+
+    tt.increaseAge();
+    EXPECT_EQ(0, tt.hashfull());
+    tt.clearAge();
+}
+
+TEST(TranspositionTableResizeTest, Positive)
+{
+    auto & tt = TTable::instance();
+    auto hash = [](U64 j) { return (j << 20) | j; };
+
+    EXPECT_EQ(true, tt.setHashSize(16, 1));
+    EXPECT_EQ(true, tt.clearHash(1));
+
+    for (auto j = 1; j < 50000; ++j)
+        tt.record(j, -j, 5, 0, HASH_BETA, hash(j), j % 1000);
+
+    //
+    //  shrink, then grow back: every entry has a cluster of its own in both tables. The compact
+    //  layout keeps only the top key bits, so it can only shrink
+    //
+
+#if defined(TT_COMPACT)
+    for (auto mb : { 4 }) {
+#else
+    for (auto mb : { 4, 16 }) {
+#endif
+        EXPECT_EQ(true, tt.setHashSize(mb, 2));
+
+        for (auto j = 1; j < 50000; ++j) {
+            TEntry hentry{};
+            EVAL staticEval;
+            EXPECT_EQ(true, tt.retrieve(hash(j), hentry, staticEval));
+            EXPECT_EQ(j, hentry.m_data.move);
+            EXPECT_EQ(-j, hentry.m_data.score);
+            EXPECT_EQ(5, hentry.m_data.depth);
+            EXPECT_EQ(HASH_BETA, hentry.m_data.type);
+        }
+    }
+
+    // a 1 Mb table indexes with 14 bits, too few to recover the keys for a larger one
+    EXPECT_EQ(true, tt.setHashSize(1, 1));
+    EXPECT_EQ(true, tt.setHashSize(8, 1));
+    EXPECT_EQ(0, tt.hashfull());
+}
+
+TEST(QuiescenceTableTest, Positive)
+{
+    QTable qt;
+    auto hash = [](U64 j) { return (j << 48) | j; };
+
+    EXPECT_EQ(false, qt.enabled());
+
+    qt.setSize(256);
+    EXPECT_EQ(true, qt.enabled());
+
+    // 4096 clusters, every entry has one of its own
+    for (auto j = 1; j < 4096; ++j)
+        qt.record(j, j, -1, 0, HASH_ALPHA, hash(j), -j);
+
+    for (auto j = 1; j < 4096; ++j) {
+        TEntry hentry{};
+        EVAL staticEval;
+        EXPECT_EQ(true, qt.retrieve(hash(j), hentry, staticEval));
+        EXPECT_EQ(j, hentry.m_data.move);
+        EXPECT_EQ(j, hentry.m_data.score);
+        EXPECT_EQ(-1, hentry.m_data.depth);
+    }
+
+    qt.clear();
+
+    for (auto j = 1; j < 4096; ++j) {
+        TEntry hentry{};
+        EVAL staticEval;
+        EXPECT_EQ(false, qt.retrieve(hash(j), hentry, staticEval));
+    }
+
+    qt.setSize(0);
+    EXPECT_EQ(false, qt.enabled());
+}
+
+TEST(TranspositionTableFileTest, Positive)
+{
+    const std::string path = "igel_test_hash.bin";
+
+    EXPECT_EQ(true, TTable::instance().setHashSize(2, 1));
+
+    for (auto j = 1; j < 16384; ++j)
+        TTable::instance().record(j, j, 3, 0, 1, j);
+
+    EXPECT_EQ(true, TTable::instance().save(path, "igel", 1));
+    EXPECT_EQ(true, TTable::instance().clearHash(1));
+
+    EXPECT_EQ(false, TTable::instance().load(path, "igel", 2));
+    EXPECT_EQ(false, TTable::instance().load(path, "other", 1));
+
+    EXPECT_EQ(true, TTable::instance().setHashSize(4, 1));
+    EXPECT_EQ(false, TTable::instance().load(path, "igel", 1));
+
+    EXPECT_EQ(true, TTable::instance().setHashSize(2, 1));
+    EXPECT_EQ(true, TTable::instance().load(path, "igel", 1));
+
+    for (auto j = 1; j < 16384; ++j) {
+        TEntry hentry{};
+        EXPECT_EQ(true, TTable::instance().retrieve(j, hentry));
+        EXPECT_EQ(j, hentry.m_data.move);
+        EXPECT_EQ(j, hentry.m_data.score);
+    }
+
+    std::remove(path.c_str());
+}
+
 TEST(TranspositionTableEntryScoreTest, Positive)
 {
     TEntry te{};
@@ -20,8 +20,10 @@
 #include "../moves.h"
 #include "../position.h"
 #include "../nnue.h"
+#include "../perft.h"
 #include "../utils.h"
 #include <gtest/gtest.h>
+#include <set>
 
 namespace unit
 {
@@ -153,6 +155,156 @@ TEST(MoveGenPos_6, Positive)
     //EXPECT_EQ(6923051137, Perft(*pos.get(), 6));
 }
 
+//
+//  walks the tree and checks that captures plus quiets add up to GenAllMoves and that
+//  isPseudoLegal accepts exactly the generated moves, including moves of a sibling position
+//
+
+void StagedGen(Position & pos, int depth, const MoveList & foreign)
+{
+    MoveList all, captures, quiets;
+
+    GenAllMoves(pos, all);
+    GenCapturesAndPromotions(pos, captures, true);
+    GenQuietMoves(pos, quiets);
+
+    std::set<U32> expected, staged;
+
+    for (size_t i = 0; i < all.Size(); ++i) {
+        expected.insert(all[i].m_mv);
+        EXPECT_TRUE(pos.isPseudoLegal(all[i].m_mv));
+    }
+
+    for (size_t i = 0; i < captures.Size(); ++i)
+        staged.insert(captures[i].m_mv);
+
+    for (size_t i = 0; i < quiets.Size(); ++i)
+        staged.insert(quiets[i].m_mv);
+
+    EXPECT_EQ(all.Size(), captures.Size() + quiets.Size());
+    EXPECT_EQ(expected, staged);
+
+    for (size_t i = 0; i < foreign.Size(); ++i)
+        EXPECT_EQ(expected.count(foreign[i].m_mv) != 0, pos.isPseudoLegal(foreign[i].m_mv));
+
+    if (depth == 0)
+        return;
+
+    for (size_t i = 0; i < all.Size(); ++i)
+    {
+        if (pos.MakeMove(all[i].m_mv))
+        {
+            StagedGen(pos, depth - 1, all);
+            pos.UnmakeMove();
+        }
+    }
+}
+
+TEST(MoveGenStaged, Positive)
+{
+    const char * fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"
+    };
+
+    for (auto fen : fens) {
+        std::unique_ptr<Position> pos(new Position);
+        EXPECT_EQ(true, pos->SetFEN(fen));
+        StagedGen(*pos, 3, MoveList{});
+    }
+}
+
+//
+//  the legal generators must produce exactly the pseudo-legal moves MakeMove accepts
+//
+
+void LegalGen(Position & pos, int depth)
+{
+    MoveList pseudo, legal, captures, quiets;
+
+    if (pos.InCheck())
+        GenMovesInCheck(pos, pseudo);
+    else
+        GenAllMoves(pos, pseudo);
+
+    std::set<U32> expected, generated, staged;
+
+    for (size_t i = 0; i < pseudo.Size(); ++i) {
+        Move mv = pseudo[i].m_mv;
+        if (pos.MakeMove(mv)) {
+            expected.insert(mv);
+            pos.UnmakeMove();
+            EXPECT_TRUE(pos.isLegal(mv));
+        }
+        else
+            EXPECT_FALSE(pos.isLegal(mv));
+    }
+
+    GenLegalMoves(pos, legal);
+
+    for (size_t i = 0; i < legal.Size(); ++i)
+        generated.insert(legal[i].m_mv);
+
+    EXPECT_EQ(expected.size(), legal.Size());
+    EXPECT_EQ(expected, generated);
+
+    if (pos.InCheck()) {
+        GenLegalEvasions(pos, captures);
+    }
+    else {
+        GenLegalCaptures(pos, captures, true);
+        GenLegalQuiets(pos, quiets);
+    }
+
+    for (size_t i = 0; i < captures.Size(); ++i)
+        staged.insert(captures[i].m_mv);
+
+    for (size_t i = 0; i < quiets.Size(); ++i)
+        staged.insert(quiets[i].m_mv);
+
+    EXPECT_EQ(expected, staged);
+
+    if (depth == 0)
+        return;
+
+    for (size_t i = 0; i < legal.Size(); ++i)
+    {
+        EXPECT_TRUE(pos.MakeMove(legal[i].m_mv));
+        LegalGen(pos, depth - 1);
+        pos.UnmakeMove();
+    }
+}
+
+TEST(MoveGenLegal, Positive)
+{
+    const char * fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "8/8/8/KPp4r/8/8/8/7k w - c6 0 1"
+    };
+
+    for (auto fen : fens) {
+        std::unique_ptr<Position> pos(new Position);
+        EXPECT_EQ(true, pos->SetFEN(fen));
+        LegalGen(*pos, 3);
+    }
+}
+
+TEST(PerftThreadsHash, Positive)
+{
+    std::unique_ptr<Position> pos(new Position);
+    EXPECT_EQ(true, pos->SetFEN("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -"));
+
+    EXPECT_EQ(4085603, ::Perft(1, 0).run(*pos, 4));
+    EXPECT_EQ(4085603, ::Perft(4, 0).run(*pos, 4));
+    EXPECT_EQ(4085603, ::Perft(4, 4).run(*pos, 4));
+    EXPECT_EQ(48, ::Perft(4, 4).run(*pos, 1));
+}
+
 TEST(Move, Positive)
 {
     MoveList mvlist;